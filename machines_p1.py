@@ -7,6 +7,17 @@ import time
 CPP_PROGRAM_PATH = "./QuartoCppCode.out"
 # CPP_PROGRAM_PATH = "./QuartoCppCode.out" #linux
 
+# 솔버를 daemon 모드로 한 번만 실행하고 계속 사용 (tree, cache, thread 유지)
+engine = None
+
+def askEngine(request):
+    global engine
+    if engine is None or engine.poll() is not None:
+        engine = subprocess.Popen([CPP_PROGRAM_PATH, "daemon", "--ponder"], text=True, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    engine.stdin.write(request.replace('\n', ' ') + '\n')
+    engine.stdin.flush()
+    return engine.stdout.readline()
+
 class P1():
     def __init__(self, board, available_pieces):
         self.pieces = [(i, j, k, l) for i in range(2) for j in range(2) for k in range(2) for l in range(2)]  # All 16 pieces
@@ -19,7 +30,7 @@ class P1():
         # if len(self.available_pieces) >= 13:
         #     return random.choice(self.available_pieces)
 
-        result = subprocess.run(CPP_PROGRAM_PATH, text=True, stdout=subprocess.PIPE, input=self.makeInput()).stdout
+        result = askEngine(self.makeInput())
         return self.pieces[int(result)]
 
 
@@ -29,7 +40,7 @@ class P1():
         #     available_locs = [(row, col) for row, col in product(range(4), range(4)) if self.board[row][col]==0]
         #     return random.choice(available_locs)
 
-        result = subprocess.run(CPP_PROGRAM_PATH, text=True, stdout=subprocess.PIPE, input=self.makeInput(selected_piece)).stdout
+        result = askEngine(self.makeInput(selected_piece))
         result = tuple(map(int, result.split(',')))
         return result
 
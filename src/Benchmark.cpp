@@ -0,0 +1,313 @@
+#include "Benchmark.h"
+#include "negamax.h"
+#include "MonteCarlo.h"
+#include "Playout.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <iostream>
+#include <future>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr int BENCHMARK_POSITION_COUNT = 8;
+    // the negamax benchmark places the 6th piece, on a board of 5
+    constexpr int BENCHMARK_FILLED_COUNT = 5;
+    // late enough that every move of the MCTS benchmark can be solved exactly
+    constexpr int MCTS_BENCHMARK_FILLED_COUNT = 6;
+    constexpr int MCTS_BENCHMARK_TIME_LIMIT_MS = 1000;
+    // early positions, where the MCTS relies on playouts
+    constexpr int PLAYOUT_BENCHMARK_FILLED_COUNT = 2;
+    constexpr int PLAYOUT_BENCHMARK_COUNT = 1 << 19;
+    // self-play from the playout benchmark positions
+    constexpr int RAVE_BENCHMARK_ITERATION_COUNT = 4000;
+    constexpr std::size_t RAVE_BENCHMARK_ARENA_MEMORY_SIZE = 64 * 1024 * 1024;
+    constexpr unsigned int BENCHMARK_SEED = 20240601;
+    constexpr std::size_t BENCHMARK_CACHE_MEMORY_SIZE = 256 * 1024 * 1024;
+
+    struct BenchmarkPosition
+    {
+        Board board;
+        PieceSet availablePieces;
+        int selectedPiece;
+    };
+
+    // random play that never hands over a terminator piece, so no position is decided at once
+    bool makeRandomPosition(std::mt19937& random, int filledCount, BenchmarkPosition& position)
+    {
+        position.board = Board();
+        position.availablePieces = PieceSet::all();
+
+        for (int placedCount = 0; placedCount <= filledCount; placedCount++)
+        {
+            std::vector<int> safePieces;
+            for (int piece : position.availablePieces)
+            {
+                if (!position.board.hasTerminatorTrait(piece))
+                    safePieces.push_back(piece);
+            }
+            if (safePieces.empty())
+                return false;
+            const int piece = safePieces[random() % safePieces.size()];
+            position.availablePieces.erase(piece);
+            if (placedCount == filledCount)
+            {
+                position.selectedPiece = piece;
+                return true;
+            }
+
+            std::vector<int> emptySquares;
+            for (int square = 0; square < SQUARE_COUNT; square++)
+            {
+                if (position.board.get(square / BOARD_COLS, square % BOARD_COLS) == -1)
+                    emptySquares.push_back(square);
+            }
+            const int square = emptySquares[random() % emptySquares.size()];
+            position.board.set(square / BOARD_COLS, square % BOARD_COLS, piece);
+        }
+        return false;
+    }
+
+    std::vector<BenchmarkPosition> makeBenchmarkPositions(int filledCount)
+    {
+        std::mt19937 random(BENCHMARK_SEED);
+        std::vector<BenchmarkPosition> positions;
+        while (static_cast<int>(positions.size()) < BENCHMARK_POSITION_COUNT)
+        {
+            BenchmarkPosition position;
+            if (makeRandomPosition(random, filledCount, position))
+                positions.push_back(position);
+        }
+        return positions;
+    }
+}
+
+void runNegamaxBenchmark()
+{
+    using namespace std::chrono;
+
+    const std::vector<BenchmarkPosition> positions = makeBenchmarkPositions(BENCHMARK_FILLED_COUNT);
+    for (bool useMoveOrdering : { false, true })
+    {
+        std::size_t totalNodeCount = 0;
+        long long totalTime = 0;
+        for (std::size_t i = 0; i < positions.size(); i++)
+        {
+            const BenchmarkPosition& position = positions[i];
+            Solver solver(position.board, position.availablePieces, BENCHMARK_CACHE_MEMORY_SIZE);
+            solver.setMoveOrdering(useMoveOrdering);
+
+            steady_clock::time_point startTime = steady_clock::now();
+            std::pair<int, int> place = solver.placePiece(position.selectedPiece);
+            long long time = duration_cast<milliseconds>(steady_clock::now() - startTime).count();
+
+            std::cerr << "position " << i << " : place " << place.first << ", " << place.second
+                << ", nodes " << solver.getNodeCount() << ", time " << time << '\n';
+            totalNodeCount += solver.getNodeCount();
+            totalTime += time;
+        }
+        std::cerr << "move ordering " << (useMoveOrdering ? "on" : "off")
+            << " : nodes " << totalNodeCount << ", time " << totalTime << "\n\n";
+    }
+}
+
+namespace
+{
+    Utility getPlaceValue(const BenchmarkPosition& position, const std::array<int, 2>& place)
+    {
+        Board board = position.board;
+        board.set(place[0], place[1], position.selectedPiece);
+        if (board.isWinnerExist())
+            return WIN;
+
+        PieceSet availablePieces = position.availablePieces;
+        availablePieces.erase(position.selectedPiece);
+        Solver solver(board, availablePieces, BENCHMARK_CACHE_MEMORY_SIZE);
+        int bestPiece;
+        return solver.solveSelect(bestPiece);
+    }
+}
+
+void runMCTSBenchmark()
+{
+    using namespace std::chrono;
+
+    const std::vector<BenchmarkPosition> positions = makeBenchmarkPositions(MCTS_BENCHMARK_FILLED_COUNT);
+    std::vector<Utility> bestValues;
+    for (const BenchmarkPosition& position : positions)
+    {
+        Solver solver(position.board, position.availablePieces, BENCHMARK_CACHE_MEMORY_SIZE);
+        std::pair<int, int> bestPlace;
+        bestValues.push_back(solver.solvePlace(position.selectedPiece, bestPlace));
+    }
+
+    struct MCTSMode
+    {
+        const char* name;
+        std::array<int, 2> (*placePiece)(const Board&, PieceSet, int, int);
+    };
+    const MCTSMode modes[] = {
+        { "root parallel", placePieceParallel },
+        { "shared tree", placePieceSharedTree },
+        { "graph", placePieceGraph },
+    };
+
+    for (const MCTSMode& mode : modes)
+    {
+        int bestMoveCount = 0;
+        long long loopCount = 0;
+        long long time = 0;
+        for (std::size_t i = 0; i < positions.size(); i++)
+        {
+            const BenchmarkPosition& position = positions[i];
+            const int loopCountBefore = totalLoopCount;
+            steady_clock::time_point startTime = steady_clock::now();
+            std::array<int, 2> place = mode.placePiece(position.board, position.availablePieces, position.selectedPiece, MCTS_BENCHMARK_TIME_LIMIT_MS);
+            time += duration_cast<milliseconds>(steady_clock::now() - startTime).count();
+            loopCount += totalLoopCount - loopCountBefore;
+
+            const Utility value = getPlaceValue(position, place);
+            std::cerr << "position " << i << " : place " << place[0] << ", " << place[1]
+                << ", value " << static_cast<int>(value) << ", best " << static_cast<int>(bestValues[i]) << '\n';
+            if (value == bestValues[i])
+                bestMoveCount++;
+        }
+        std::cerr << mode.name << " : best moves " << bestMoveCount << " / " << positions.size()
+            << ", iterations per second " << loopCount * 1000 / time << "\n\n";
+    }
+}
+
+void runPlayoutBenchmark()
+{
+    using namespace std::chrono;
+
+    const std::vector<BenchmarkPosition> positions = makeBenchmarkPositions(PLAYOUT_BENCHMARK_FILLED_COUNT);
+    PlayoutRandom random(BENCHMARK_SEED);
+    long long totalTime = 0;
+    for (std::size_t i = 0; i < positions.size(); i++)
+    {
+        const BenchmarkPosition& position = positions[i];
+        // results for the player placing the selected piece : loss, draw, win
+        std::array<int, 3> resultCounts{};
+        steady_clock::time_point startTime = steady_clock::now();
+        for (int playoutIndex = 0; playoutIndex < PLAYOUT_BENCHMARK_COUNT; playoutIndex++)
+        {
+            Playout playout(position.board, position.availablePieces);
+            resultCounts[playout.playPlace(position.selectedPiece, random) + 1]++;
+        }
+        totalTime += duration_cast<microseconds>(steady_clock::now() - startTime).count();
+
+        std::cerr << "position " << i << " : win " << resultCounts[2] << ", draw " << resultCounts[1]
+            << ", loss " << resultCounts[0] << '\n';
+    }
+    std::cerr << "playouts per second " << PLAYOUT_BENCHMARK_COUNT * static_cast<long long>(positions.size()) * 1000000 / totalTime << '\n';
+}
+
+namespace
+{
+    // a single threaded search of a fixed iteration count with playouts only, so the sides differ in nothing but RAVE
+    int selectPieceByIterations(const Board& board, PieceSet availablePieces, int raveEquivalence)
+    {
+        MCSolver solver(board, availablePieces);
+        solver.setRave(raveEquivalence);
+        solver.setIterationLimit(RAVE_BENCHMARK_ITERATION_COUNT);
+        int bestPiece = -1;
+        double maxRank = 0;
+        for (const auto& [piece, rank] : solver.selectPiece(RAVE_BENCHMARK_ARENA_MEMORY_SIZE))
+        {
+            if (rank > maxRank)
+            {
+                maxRank = rank;
+                bestPiece = piece;
+            }
+        }
+        // every piece left is a terminator
+        if (bestPiece == -1)
+            bestPiece = *availablePieces.begin();
+        return bestPiece;
+    }
+
+    std::array<int, 2> placePieceByIterations(const Board& board, PieceSet availablePieces, int selectedPiece, int raveEquivalence)
+    {
+        MCSolver solver(board, availablePieces);
+        solver.setRave(raveEquivalence);
+        solver.setIterationLimit(RAVE_BENCHMARK_ITERATION_COUNT);
+        std::array<int, 2> bestPlace = { -1, -1 };
+        double maxRank = 0;
+        for (const auto& [place, rank] : solver.placePiece(selectedPiece, RAVE_BENCHMARK_ARENA_MEMORY_SIZE))
+        {
+            if (rank > maxRank)
+            {
+                maxRank = rank;
+                bestPlace = place;
+            }
+        }
+        return bestPlace;
+    }
+
+    // plays the game out from the position. raveEquivalences[side] : side 0 places the selected piece first.
+    // returns 1 if side 0 wins, 0 for a draw, -1 if side 1 wins
+    int playGame(BenchmarkPosition position, std::array<int, 2> raveEquivalences)
+    {
+        int side = 0;
+        while (true)
+        {
+            const std::array<int, 2> place = placePieceByIterations(position.board, position.availablePieces, position.selectedPiece, raveEquivalences[side]);
+            position.board.set(place[0], place[1], position.selectedPiece);
+            if (position.board.isWinnerExist())
+                return side == 0 ? 1 : -1;
+            if (position.board.isFull())
+                return 0;
+
+            position.selectedPiece = selectPieceByIterations(position.board, position.availablePieces, raveEquivalences[side]);
+            position.availablePieces.erase(position.selectedPiece);
+            side = 1 - side;
+        }
+    }
+}
+
+void runRaveBenchmark(int roundCount, int raveEquivalence)
+{
+    const std::vector<BenchmarkPosition> positions = makeBenchmarkPositions(PLAYOUT_BENCHMARK_FILLED_COUNT);
+    // results for the RAVE side, [position][raveSide] : loss, draw, win
+    std::vector<std::array<std::array<int, 3>, 2>> positionResultCounts(positions.size());
+    std::vector<std::future<void>> games;
+    for (std::size_t i = 0; i < positions.size(); i++)
+    {
+        for (int raveSide = 0; raveSide < 2; raveSide++)
+        {
+            games.push_back(ThreadPool::getShared().submit([&positions, &positionResultCounts, i, raveSide, roundCount, raveEquivalence]
+                {
+                    std::array<int, 2> raveEquivalences = { 0, 0 };
+                    raveEquivalences[raveSide] = raveEquivalence;
+                    std::array<int, 3>& resultCounts = positionResultCounts[i][raveSide];
+                    for (int round = 0; round < roundCount; round++)
+                    {
+                        const int result = playGame(positions[i], raveEquivalences);
+                        resultCounts[(raveSide == 0 ? result : -result) + 1]++;
+                    }
+                }));
+        }
+    }
+    for (auto& game : games)
+        game.get();
+
+    std::array<int, 3> resultCounts{};
+    for (std::size_t i = 0; i < positions.size(); i++)
+    {
+        std::cerr << "position " << i;
+        for (int raveSide = 0; raveSide < 2; raveSide++)
+        {
+            const std::array<int, 3>& sideResultCounts = positionResultCounts[i][raveSide];
+            std::cerr << (raveSide == 0 ? " : rave first " : ", rave second ") << sideResultCounts[2] << " / "
+                << sideResultCounts[1] << " / " << sideResultCounts[0];
+            for (int result = 0; result < 3; result++)
+                resultCounts[result] += sideResultCounts[result];
+        }
+        std::cerr << '\n';
+    }
+    std::cerr << "rave " << raveEquivalence << " against UCB1 at " << RAVE_BENCHMARK_ITERATION_COUNT
+        << " iterations per move : win " << resultCounts[2] << ", draw " << resultCounts[1] << ", loss " << resultCounts[0] << '\n';
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// solves a fixed set of positions, the place of the 6th piece, with move ordering off and on,
+// and prints node count and time of each to stderr
+void runNegamaxBenchmark();
+
+// runs each MCTS mode on the same positions for the same time,
+// and prints how often each picks a move of the best exact value and iterations per second
+void runMCTSBenchmark();
+
+// plays random games from a fixed set of positions on one thread,
+// and prints the results of each position and playouts per second
+void runPlayoutBenchmark();
+
+// each position is played roundCount times from both sides
+constexpr int RAVE_BENCHMARK_ROUND_COUNT = 8;
+// k of the RAVE side
+constexpr int RAVE_BENCHMARK_RAVE_EQUIVALENCE = 100;
+
+// plays games between a single thread MCTS with RAVE and one without, at the same iteration count per move,
+// and prints the results of the RAVE side
+void runRaveBenchmark(int roundCount = RAVE_BENCHMARK_ROUND_COUNT, int raveEquivalence = RAVE_BENCHMARK_RAVE_EQUIVALENCE);
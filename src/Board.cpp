@@ -2,287 +2,231 @@
 #include <algorithm>
 #include <iostream>
 
-std::bitset<4> getSamePieceTraits(const std::vector<int>& pieces)
-{
-    std::bitset<4> result = 0b1111;
-    for (int i = 1; i < pieces.size(); i++)
-    {
-        result &= ~(pieces[i - 1] ^ pieces[i]);
-    }
-    return result;
-}
-
 Board::Board()
 {
-    for (auto& row : board)
-    {
-        for (auto& element : row)
-        {
-            element = -1;
-        }
-    }
 }
 
 void Board::print() const
 {
-    for (const auto& row : board)
+    for (int row = 0; row < BOARD_ROWS; row++)
     {
-        for (int element : row)
+        for (int col = 0; col < BOARD_COLS; col++)
         {
-            std::cout << element << ' ';
+            std::cout << get(row, col) << ' ';
         }
         std::cout << '\n';
     }
 }
 
-std::vector<std::vector<int>> Board::copyRotateRight(const std::vector<std::vector<int>>& originalBoard) {
-    std::vector<std::vector<int>> result{ BOARD_ROWS, std::vector<int>(BOARD_COLS) };
-    for (int rowIndex = 0; rowIndex < BOARD_ROWS; rowIndex++)
+// SYMMETRY_SQUARES[symmetry][square] : where the square goes under the symmetry
+constexpr std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> makeSymmetrySquares()
+{
+    std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> result{};
+    for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
     {
-        for (int colIndex = 0; colIndex < BOARD_COLS; colIndex++)
+        for (int row = 0; row < BOARD_ROWS; row++)
         {
-            result[colIndex][BOARD_ROWS - 1 - rowIndex] = originalBoard[rowIndex][colIndex];
+            for (int col = 0; col < BOARD_COLS; col++)
+            {
+                int imageRow = row;
+                int imageCol = col;
+                // rotate right
+                for (int i = 0; i < symmetry % 4; i++)
+                {
+                    int previousRow = imageRow;
+                    imageRow = imageCol;
+                    imageCol = BOARD_ROWS - 1 - previousRow;
+                }
+                // mirror up down
+                if (symmetry >= 4)
+                    imageRow = BOARD_ROWS - 1 - imageRow;
+                result[symmetry][row * BOARD_COLS + col] = imageRow * BOARD_COLS + imageCol;
+            }
         }
     }
     return result;
 }
 
-std::vector<std::vector<int>> Board::copyMirrorUpDown(const std::vector<std::vector<int>>& originalBoard) {
-    std::vector<std::vector<int>> result{ BOARD_ROWS, std::vector<int>(BOARD_COLS) };
-    for (int i = 0; i < 4; i++)
+constexpr std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> SYMMETRY_SQUARES = makeSymmetrySquares();
+
+constexpr std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> makeInverseSymmetrySquares()
+{
+    std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> result{};
+    for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
     {
-        std::copy(originalBoard[i].begin(), originalBoard[i].end(), result[3 - i].begin());
+        for (int square = 0; square < SQUARE_COUNT; square++)
+            result[symmetry][SYMMETRY_SQUARES[symmetry][square]] = square;
     }
     return result;
 }
 
-int Board::getBoardPlaced16Bit(const Matrix& board)
+constexpr std::array<std::array<int, SQUARE_COUNT>, SYMMETRY_COUNT> INVERSE_SYMMETRY_SQUARES = makeInverseSymmetrySquares();
+
+int SymmetryTransform::toCanonicalSquare(int square) const
 {
-    int result = 0;
-    for (const auto& row : board)
-    {
-        for (int element : row)
-        {
-            result << 1;
-            if (element != -1)
-                result++;
-        }
-    }
-    return result;
+    return SYMMETRY_SQUARES[symmetry][square];
 }
 
-std::vector<int> Board::permutation4Bit(int original)
+int SymmetryTransform::fromCanonicalSquare(int square) const
 {
-    std::vector<int> result;
-    permutation4BitRecursive(0, 0, original, 0, result);
-    return result;
+    return INVERSE_SYMMETRY_SQUARES[symmetry][square];
 }
 
-void Board::permutation4BitRecursive(std::bitset<4> current, int nextPlacedIndex, std::bitset<4> original, std::bitset<4> used, std::vector<int>& result)
+int SymmetryTransform::toCanonicalPiece(int piece) const
 {
-    if (nextPlacedIndex == 4)
+    piece ^= anchor;
+    int result = 0;
+    for (int trait = 0; trait < TRAIT_COUNT; trait++)
     {
-        result.push_back(current.to_ulong());
+        if (piece & (1 << traitOrder[trait]))
+            result |= 1 << trait;
     }
-    for (int i = 0; i < 4; i++)
+    return result;
+}
+
+int SymmetryTransform::fromCanonicalPiece(int piece) const
+{
+    int result = 0;
+    for (int trait = 0; trait < TRAIT_COUNT; trait++)
     {
-        if (used[i] == false)
-        {
-            std::bitset<4> temp = current;
-            std::bitset<4> usedCopy = used;
-            usedCopy[i] = true;
-            temp[nextPlacedIndex] = original[i];
-            permutation4BitRecursive(temp, nextPlacedIndex + 1, original, usedCopy, result);
-        }
+        if (piece & (1 << trait))
+            result |= 1 << traitOrder[trait];
     }
+    return result ^ anchor;
 }
 
-long long Board::getCompactExpression(const std::bitset<17 * 5>& board)
+// bits needed to write the index of a piece among the remaining piece count
+constexpr std::array<int, PIECE_COUNT + 1> PIECE_INDEX_BITS = { 0, 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+constexpr int MAX_PIECE_INDEX_BITS = 4 * 7 + 3 * 4 + 2 * 2 + 1 * 1;
+
+// XOR every piece with the anchor piece (select, or the first placed piece),
+// then take the smallest of the 24 trait permutations.
+// a trait permutation only reorders the planes, so the smallest one is the sorted planes.
+std::uint64_t normalizeImage(SymmetryImage& image, int select, SymmetryTransform& transform)
 {
-    std::vector<std::bitset<5>> boardSplited(17);
-    for (int splitIndex = 0; splitIndex < 17; splitIndex++)
+    int& anchor = transform.anchor;
+    anchor = select;
+    if (anchor == -1)
     {
-        for (int traitIndex = 0; traitIndex < 5; traitIndex++)
+        anchor = 0;
+        const SquareMask firstPlaced = image.occupied & (~image.occupied + 1);
+        for (int trait = 0; trait < TRAIT_COUNT; trait++)
         {
-            boardSplited[16 - splitIndex][traitIndex] = board[splitIndex * 5 + traitIndex];
+            if (image.traitPlanes[trait] & firstPlaced)
+                anchor |= 1 << trait;
         }
     }
 
-    long long result = 0;
-    // write 17bit flag
-    for (const auto& aSplit : boardSplited)
+    auto& planes = image.traitPlanes;
+    for (int trait = 0; trait < TRAIT_COUNT; trait++)
     {
-        result <<= 1;
-        if (!aSplit[4])
-            result++;
+        if (anchor & (1 << trait))
+            planes[trait] ^= image.occupied;
     }
 
-    int writtenBitCount = 17;
-
-    // write piece type;
-    std::vector<unsigned long> remainPieces(15);
-    bool isZeroPieceUsed = false;
-    int neededBitCountForPiece = 4;
-    for (int i = 0; i < 15; i++)
-    {
-        remainPieces[i] = i + 1;
-    }
-    for (int i = 0; i < 17; i++)
-    {
-        if (!boardSplited[i][4])
+    auto& traitOrder = transform.traitOrder;
+    traitOrder = { 0, 1, 2, 3 };
+    auto compareSwap = [&planes, &traitOrder](int first, int second)
         {
-            if (!isZeroPieceUsed)
+            if (planes[second] < planes[first])
             {
-                isZeroPieceUsed = true;
+                std::swap(planes[first], planes[second]);
+                std::swap(traitOrder[first], traitOrder[second]);
             }
-            else if (remainPieces.size() > 1)
-            {
-                unsigned long currentPieceToExpress = boardSplited[i].to_ulong();
-                auto foundIndexIter = std::find(remainPieces.begin(), remainPieces.end(), currentPieceToExpress);
-                unsigned long foundIndex = foundIndexIter - remainPieces.begin();
-                remainPieces.erase(foundIndexIter);
-
-                result <<= neededBitCountForPiece;
-                result += foundIndex;
-                writtenBitCount += neededBitCountForPiece;
-
-                switch (remainPieces.size())
-                {
-                case 8:
-                    neededBitCountForPiece = 3;
-                    break;
-                case 4:
-                    neededBitCountForPiece = 2;
-                    break;
-                case 2:
-                    neededBitCountForPiece = 1;
-                    break;
-                }
-            }
-        }
-    }
-
-    result <<= 64 - writtenBitCount;
-    return result;
+        };
+    compareSwap(0, 1);
+    compareSwap(2, 3);
+    compareSwap(0, 2);
+    compareSwap(1, 3);
+    compareSwap(1, 2);
+
+    return (std::uint64_t{ planes[0] } << 48) | (std::uint64_t{ planes[1] } << 32)
+        | (std::uint64_t{ planes[2] } << 16) | std::uint64_t{ planes[3] };
 }
 
-long long Board::getNormalized(int select) const
+// the images come from Board::set. the anchor XOR, the trait sort and the encoding are done on each call
+long long getCanonicalKey(const std::array<SymmetryImage, SYMMETRY_COUNT>& images, int select, SymmetryTransform& transform)
 {
-    // make board place symmetrics
-    std::vector<std::pair<int, Matrix>> placeSymetrics;
-    placeSymetrics.reserve(8);
-    placeSymetrics.push_back({ getBoardPlaced16Bit(board),board });
-    for (int i = 0; i < 3; i++)
-    {
-        Matrix rotated = copyRotateRight(placeSymetrics[i].second);
-        int rotatedBoardPlace16Bit = getBoardPlaced16Bit(rotated);
-        placeSymetrics.push_back({ rotatedBoardPlace16Bit, std::move(rotated) });
-    }
-    for (int i = 0; i < 4; i++)
-    {
-        Matrix mirrored = copyMirrorUpDown(placeSymetrics[i].second);
-        int mirroredBoardPlace16Bit = getBoardPlaced16Bit(mirrored);
-        placeSymetrics.push_back({ mirroredBoardPlace16Bit, std::move(mirrored) });
-    }
-
-    std::sort(placeSymetrics.begin(), placeSymetrics.end(), [](const auto& element1, const auto& element2)
-        {
-            return element1.first < element2.first;
-        });
-
-    std::vector<Matrix> candidates;
-    int largestPlace16Bit = placeSymetrics.back().first;
-    candidates.push_back(placeSymetrics.back().second);
-    placeSymetrics.pop_back();
-    while (!placeSymetrics.empty() && placeSymetrics.back().first == largestPlace16Bit)
-    {
-        candidates.push_back(placeSymetrics.back().second);
-        placeSymetrics.pop_back();
-    }
-
-    // piece XOR
-    for (auto& candidate : candidates)
+    // only the images with the smallest place flags need their pieces compared
+    SquareMask minOccupied = images[0].occupied;
+    for (int symmetry = 1; symmetry < SYMMETRY_COUNT; symmetry++)
+        minOccupied = std::min(minOccupied, images[symmetry].occupied);
+
+    SymmetryImage best;
+    std::uint64_t bestPlanes = 0;
+    bool isBestFound = false;
+    for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
     {
-        int firstPiece = -1;
-        if (select != -1)
+        if (images[symmetry].occupied != minOccupied)
+            continue;
+        SymmetryImage candidate = images[symmetry];
+        SymmetryTransform candidateTransform;
+        candidateTransform.symmetry = symmetry;
+        std::uint64_t candidatePlanes = normalizeImage(candidate, select, candidateTransform);
+        if (!isBestFound || candidatePlanes < bestPlanes)
         {
-            firstPiece = select;
-        }
-        for (auto& row : candidate)
-        {
-            for (auto& piece : row)
-            {
-                if (piece != -1) {
-                    if (firstPiece == -1)
-                    {
-                        firstPiece = piece;
-                        piece ^= firstPiece;
-                    }
-                    else
-                    {
-                        piece ^= firstPiece;
-                    }
-                }
-            }
+            best = candidate;
+            bestPlanes = candidatePlanes;
+            transform = candidateTransform;
+            isBestFound = true;
         }
     }
 
-    // permutate Piece
-    std::vector<std::bitset<17 * 5>> permutatedStoredTotal;
-    for (auto& candidate : candidates)
+    // write select flag and place flags, then each piece as an index among the unused pieces.
+    // the anchor piece is always 0, so it is not written.
+    long long result = ((select != -1 ? 1LL : 0LL) << SQUARE_COUNT) | best.occupied;
+    result <<= MAX_PIECE_INDEX_BITS;
+
+    int writtenBitCount = 0;
+    std::uint32_t remainPieces = 0xFFFE;
+    bool isZeroPieceUsed = select != -1;
+    for (SquareMask placed = best.occupied; placed != 0; placed &= placed - 1)
     {
-        std::vector<std::bitset<17 * 5>> permutatedStored(24);
-        for (auto& aStored : permutatedStored)
+        const SquareMask squareBit = placed & (~placed + 1);
+        if (!isZeroPieceUsed)
         {
-            aStored <<= 5;
-            if (select == -1)
-                aStored[4] = true;
+            isZeroPieceUsed = true;
+            continue;
         }
-        for (auto& row : candidate)
+
+        int piece = 0;
+        for (int trait = 0; trait < TRAIT_COUNT; trait++)
         {
-            for (int element : row)
-            {
-                if (element == -1)
-                {
-                    for (int i = 0; i < 24; i++)
-                    {
-                        permutatedStored[i] <<= 5;
-                        permutatedStored[i][4] = true;
-                    }
-                }
-                else {
-                    auto permutatedElement = permutation4Bit(element);
-                    for (int i = 0; i < 24; i++)
-                    {
-                        permutatedStored[i] <<= 5;
-                        for (int j = 0; j < 4; j++)
-                        {
-                            permutatedStored[i][j] = (permutatedElement[i] & (0b1 << j)) > 0;
-                        }
-                    }
-                }
-            }
+            if (best.traitPlanes[trait] & squareBit)
+                piece |= 1 << trait;
         }
-        permutatedStoredTotal.insert(permutatedStoredTotal.end(), permutatedStored.begin(), permutatedStored.end());
+
+        const int neededBitCountForPiece = PIECE_INDEX_BITS[countBits(remainPieces)];
+        const int foundIndex = countBits(remainPieces & ((1u << piece) - 1));
+        remainPieces &= ~(1u << piece);
+
+        writtenBitCount += neededBitCountForPiece;
+        result |= static_cast<long long>(foundIndex) << (MAX_PIECE_INDEX_BITS - writtenBitCount);
     }
+    return result;
+}
 
-    auto uncompactResult = std::max_element(permutatedStoredTotal.begin(), permutatedStoredTotal.end(), [](const auto& par1, const auto& par2)
-        {
-            for (int i = 84; i >= 0; i--)
-            {
-                if (par1[i] < par2[i])
-                    return true;
-                else if (par1[i] > par2[i])
-                    return false;
-            }
-            return false;
-        });
-    return getCompactExpression(*uncompactResult);
+long long Board::getNormalized(int select) const
+{
+    SymmetryTransform transform;
+    return getCanonicalKey(symmetryImages, select, transform);
+}
+
+long long Board::getNormalized(int select, SymmetryTransform& transform) const
+{
+    return getCanonicalKey(symmetryImages, select, transform);
+}
+
+int Board::getAt(int square) const
+{
+    if (!(occupied & (1u << square)))
+        return -1;
+    return static_cast<int>((pieces >> (square * 4)) & 0xF);
 }
 
 int Board::get(int row, int col) const
 {
-    return board[row][col];
+    return getAt(row * BOARD_COLS + col);
 }
 
 void Board::setBoardFromStdin()
@@ -300,217 +244,328 @@ void Board::setBoardFromStdin()
 
 void Board::set(int row, int col, int select)
 {
-    if (board[row][col] == select)
+    const int square = row * BOARD_COLS + col;
+    const int current = getAt(square);
+    if (current == select)
         return;
 
-    checkLines(row, col, select);
+    updateGroupState(square, -1);
+
+    const SquareMask bit = static_cast<SquareMask>(1u << square);
+    pieces &= ~(std::uint64_t{ 0xF } << (square * 4));
     if (select == -1)
     {
+        occupied &= ~bit;
+        for (auto& plane : traitPlanes)
+            plane &= ~bit;
+        for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
+        {
+            const SquareMask imageBit = static_cast<SquareMask>(1u << SYMMETRY_SQUARES[symmetry][square]);
+            SymmetryImage& image = symmetryImages[symmetry];
+            image.occupied &= ~imageBit;
+            for (auto& plane : image.traitPlanes)
+                plane &= ~imageBit;
+        }
         filledCount--;
     }
-    else if (select != -1 && board[row][col] == -1)
+    else
     {
-        filledCount++;
+        if (current == -1)
+            filledCount++;
+        occupied |= bit;
+        pieces |= static_cast<std::uint64_t>(select) << (square * 4);
+        for (int trait = 0; trait < TRAIT_COUNT; trait++)
+        {
+            if (select & (1 << trait))
+                traitPlanes[trait] |= bit;
+            else
+                traitPlanes[trait] &= ~bit;
+        }
+        for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
+        {
+            const SquareMask imageBit = static_cast<SquareMask>(1u << SYMMETRY_SQUARES[symmetry][square]);
+            SymmetryImage& image = symmetryImages[symmetry];
+            image.occupied |= imageBit;
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                if (select & (1 << trait))
+                    image.traitPlanes[trait] |= imageBit;
+                else
+                    image.traitPlanes[trait] &= ~imageBit;
+            }
+        }
     }
-    board[row][col] = select;
+
+    updateGroupState(square, 1);
 }
 
 bool Board::isFull() const
 {
-    //for (const auto& row : board)
-    //    for (const auto& element : row)
-    //        if (element == -1)
-    //            return false;
     return filledCount == PIECE_COUNT;
 }
 
-void Board::checkLines(int changedRow, int changedCol, int select)
+void Board::updateGroupState(int square, int sign)
 {
-    // check row
-    (select == -1) ? checkRemoveInLine(board[changedRow], board[changedRow][changedCol]) : checkAddInLine(board[changedRow], select);
-
-    // check col
-    std::vector<int> lineCol;
-    lineCol.reserve(BOARD_ROWS);
-    for (int i = 0; i < BOARD_ROWS; i++)
-        lineCol.push_back(board[i][changedCol]);
-    (select == -1) ? checkRemoveInLine(std::move(lineCol), board[changedRow][changedCol])
-        : checkAddInLine(std::move(lineCol), select);
-
-    // 밢
-    std::vector<int> lineDiag;
-    lineDiag.reserve(BOARD_COLS);
-    if (changedRow == changedCol)
+    const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+    for (int i = 0; i < squareGroups.count; i++)
     {
-        for (int i = 0; i < BOARD_ROWS; i++)
-            lineDiag.push_back(board[i][i]);
-
-        (select == -1) ? checkRemoveInLine(std::move(lineDiag), board[changedRow][changedCol])
-            : checkAddInLine(std::move(lineDiag), select);
-    }
-    else if (changedRow + changedCol == BOARD_ROWS - 1)
-    {
-        for (int i = 0; i < BOARD_ROWS; i++)
-            lineDiag.push_back(board[i][BOARD_ROWS - i - 1]);
-
-        (select == -1) ? checkRemoveInLine(std::move(lineDiag), board[changedRow][changedCol])
-            : checkAddInLine(std::move(lineDiag), select);
+        const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+        const SquareMask filled = occupied & group;
+        const int groupFilledCount = countBits(filled);
+        // 3 pieces sharing a trait value make that trait value a terminator
+        if (groupFilledCount == 3)
+        {
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                const SquareMask ones = traitPlanes[trait] & group;
+                if (ones == filled)
+                    terminatorPlaceCount[trait][1] += sign;
+                else if (ones == 0)
+                    terminatorPlaceCount[trait][0] += sign;
+            }
+        }
+        // 4 pieces sharing a trait value is a win
+        else if (groupFilledCount == 4)
+        {
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                const SquareMask ones = traitPlanes[trait] & group;
+                if (ones == group || ones == 0)
+                {
+                    winningGroupCount += sign;
+                    break;
+                }
+            }
+        }
     }
+}
 
-    // 2x2 üũ
-    check2x2(changedRow, changedCol, -1, -1, select);
-    check2x2(changedRow, changedCol, 1, -1, select);
-    check2x2(changedRow, changedCol, -1, 1, select);
-    check2x2(changedRow, changedCol, 1, 1, select);
-}
-
-bool Board::check2x2(int changedRow, int changedCol, int dRow, int dCol, int select)
-{
-    if (0 <= changedRow + dRow && changedRow + dRow < BOARD_ROWS
-        && 0 <= changedCol + dCol && changedCol + dCol < BOARD_COLS) {
-        if (select != -1)
-            checkAddInLine({ board[changedRow][changedCol],
-                board[changedRow + dRow][changedCol],
-                board[changedRow][changedCol + dCol],
-                board[changedRow + dRow][changedCol + dCol] }, select);
-        else
-            checkRemoveInLine({ board[changedRow][changedCol],
-                board[changedRow + dRow][changedCol],
-                board[changedRow][changedCol + dCol],
-                board[changedRow + dRow][changedCol + dCol] }, board[changedRow][changedCol]);
+bool Board::hasTerminatorTrait(int piece) const
+{
+    for (int bitPlace = 0, bitPicker = 0b1; bitPlace < TRAIT_COUNT; bitPlace++, bitPicker *= 2)
+    {
+        bool pickedBitValue = (piece & bitPicker) > 0;
+        if (terminatorPlaceCount[bitPlace][pickedBitValue] > 0)
+            return true;
     }
     return false;
 }
 
-// called before board field change
-void Board::checkAddInLine(std::vector<int> line, int pieceToAdd)
+int Board::getTerminatorGroupCount(int trait, int value) const
 {
-    // remove -1
-    auto removeIter = std::remove_if(line.begin(), line.end(), [](int lineElement) {return lineElement == -1; });
-    line.erase(removeIter, line.end());
+    return terminatorPlaceCount[trait][value];
+}
 
-    // 2 -> 3 ߰Ǵ  terminator trait 
-    if (line.size() == 2)
+std::array<int, 2> Board::getTerminatingPlace(int terminatingPiece) const
+{
+    for (int square = 0; square < SQUARE_COUNT; square++)
     {
-        //int equalBits = 0b1111;
-        //equalBits &= ~(line[0] ^ line[1]);
-        //equalBits &= ~(line[1] ^ pieceToAdd);
-        std::bitset<4> equalBits = getSamePieceTraits({ line[0], line[1], pieceToAdd });
-        for (int bitPlace = 0; bitPlace < TRAIT_COUNT; bitPlace++)
+        if (occupied & (1u << square))
+            continue;
+
+        const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+        for (int i = 0; i < squareGroups.count; i++)
         {
-            if (equalBits[bitPlace] == true) {
-                bool pickedBitValue = (line[0] & (0b1 << bitPlace)) > 0;
-                terminatorPlaceCount[bitPlace][pickedBitValue]++;
+            const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+            const SquareMask filled = occupied & group;
+            if (countBits(filled) != 3)
+                continue;
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                const SquareMask ones = traitPlanes[trait] & group;
+                const bool pieceBit = (terminatingPiece & (1 << trait)) != 0;
+                if ((pieceBit && ones == filled) || (!pieceBit && ones == 0))
+                    return { square / BOARD_COLS, square % BOARD_COLS };
             }
         }
     }
-    // 3->4 ߰Ǵ  terminator trait   
-    else if (line.size() == 3)
-    {
-        //int equalBits = 0b1111;
-        //for (int i = 1; i < line.size(); i++)
-        //{
-        //    equalBits &= ~(line[i - 1] ^ line[i]);
-        //}
-        std::bitset<4> equalBits = getSamePieceTraits(line);
-
-        for (int bitPlace = 0; bitPlace < TRAIT_COUNT; bitPlace++)
-        {
-            if (equalBits[bitPlace]) {
-                bool pickedBitValue = (line[0] & (0b1 << bitPlace)) > 0;
-                terminatorPlaceCount[bitPlace][pickedBitValue]--;
-            }
-        }
+    return { -1,-1 };
+}
 
-        // terminated state Ȯ
-        equalBits &= ~std::bitset<4>(line[0] ^ pieceToAdd);
-        if (equalBits.any())
-            m_isWinnerExist = true;
+
+// trait values shared by every piece in the group. bit trait : shared 1, bit TRAIT_COUNT + trait : shared 0
+int getSharedTraits(SquareMask group, SquareMask occupied, const std::array<SquareMask, TRAIT_COUNT>& traitPlanes)
+{
+    const SquareMask filled = occupied & group;
+    int sharedTraits = 0;
+    for (int trait = 0; trait < TRAIT_COUNT; trait++)
+    {
+        const SquareMask ones = traitPlanes[trait] & group;
+        if (ones == filled)
+            sharedTraits |= 1 << trait;
+        if (ones == 0)
+            sharedTraits |= 1 << (TRAIT_COUNT + trait);
     }
+    return sharedTraits;
 }
 
-// called before board field change
-void Board::checkRemoveInLine(std::vector<int> line, int pieceToRemove)
+int getSharedTraitsWith(int sharedTraits, int piece)
 {
-    // remove -1
-    auto removeIter = std::remove_if(line.begin(), line.end(), [](int lineElement) {return lineElement == -1; });
-    line.erase(removeIter, line.end());
+    return sharedTraits & (piece | ((~piece & 0xF) << TRAIT_COUNT));
+}
+
+int Board::getPlaceScore(int row, int col, int piece) const
+{
+    const int square = row * BOARD_COLS + col;
+    int blockedCount = 0;
+    int newTerminatorCount = 0;
+    const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+    for (int i = 0; i < squareGroups.count; i++)
+    {
+        const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+        const int sharedTraits = getSharedTraits(group, occupied, traitPlanes);
+        const int sharedTraitsAfter = getSharedTraitsWith(sharedTraits, piece);
+        if (sharedTraits != 0 && sharedTraitsAfter == 0)
+            blockedCount++;
+        if (countBits(occupied & group) == 2)
+            newTerminatorCount += countBits(sharedTraitsAfter);
+    }
+    return blockedCount - newTerminatorCount;
+}
 
-    // 3->2 ϴ  terminator trait 
-    if (line.size() == 3)
+int Board::getSafePlaceCount(int piece) const
+{
+    int safePlaceCount = 0;
+    for (int square = 0; square < SQUARE_COUNT; square++)
     {
-        std::bitset<4> equalBits = getSamePieceTraits(line);
-        for (int bitPlace = 0; bitPlace < TRAIT_COUNT; bitPlace++)
+        if (occupied & (1u << square))
+            continue;
+
+        bool isSafe = true;
+        const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+        for (int i = 0; i < squareGroups.count && isSafe; i++)
         {
-            if (equalBits[bitPlace]) {
-                bool pickedBitValue = (line[0] & (0b1 << bitPlace)) > 0;
-                terminatorPlaceCount[bitPlace][pickedBitValue]--;
-            }
+            const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+            if (countBits(occupied & group) == 2 && getSharedTraitsWith(getSharedTraits(group, occupied, traitPlanes), piece) != 0)
+                isSafe = false;
         }
+        if (isSafe)
+            safePlaceCount++;
     }
-    // 4 -> 3 ҵǴ  terminator trait 
-    else if (line.size() == 4)
+    return safePlaceCount;
+}
+
+bool Board::isWinnerExist() const
+{
+    return winningGroupCount > 0;
+}
+
+int Board::getFilledCount() const
+{
+    return filledCount;
+}
+
+SquareMask Board::getOccupied() const
+{
+    return occupied;
+}
+
+SquareMask Board::getTraitPlane(int trait) const
+{
+    return traitPlanes[trait];
+}
+// a trait permutation and XOR that, together with a board symmetry, maps the position to itself.
+// the piece p goes to the piece whose trait t is (trait traitSource[t] of p) ^ (bit t of flip)
+struct PieceMap
+{
+    std::array<int, TRAIT_COUNT> traitSource{};
+    int flip = 0;
+
+    int apply(int piece) const
     {
-        // line  piece   terminator trait 
-        line.erase(std::find(line.begin(), line.end(), pieceToRemove));
+        int result = 0;
+        for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            result |= ((piece >> traitSource[trait]) & 1) << trait;
+        return result ^ flip;
+    }
+};
 
-        std::bitset<4> equalBits = getSamePieceTraits(line);
+// matches the planes of the image with the planes of the board one trait at a time
+template <typename Function>
+void matchTraits(const SymmetryImage& image, const std::array<SquareMask, TRAIT_COUNT>& traitPlanes, int trait, int usedTraits, PieceMap& pieceMap, Function& function)
+{
+    if (trait == TRAIT_COUNT)
+    {
+        function(pieceMap);
+        return;
+    }
 
-        for (int bitPlace = 0; bitPlace < TRAIT_COUNT; bitPlace++)
+    for (int source = 0; source < TRAIT_COUNT; source++)
+    {
+        if (usedTraits & (1 << source))
+            continue;
+        pieceMap.traitSource[trait] = source;
+        const SquareMask plane = image.traitPlanes[source];
+        if (plane == traitPlanes[trait])
         {
-            if (equalBits[bitPlace]) {
-                bool pickedBitValue = (line[0] & (0b1 << bitPlace)) > 0;
-                terminatorPlaceCount[bitPlace][pickedBitValue]++;
-            }
+            pieceMap.flip &= ~(1 << trait);
+            matchTraits(image, traitPlanes, trait + 1, usedTraits | (1 << source), pieceMap, function);
+        }
+        // on the empty board both the plane and its complement match
+        if ((plane ^ image.occupied) == traitPlanes[trait])
+        {
+            pieceMap.flip |= 1 << trait;
+            matchTraits(image, traitPlanes, trait + 1, usedTraits | (1 << source), pieceMap, function);
         }
-
-        // terminated state false ٲ  Ȯ
-        equalBits &= ~std::bitset<4>(line[0] ^ pieceToRemove);
-        if (equalBits.any())
-            m_isWinnerExist = false;
     }
 }
 
-bool Board::hasTerminatorTrait(int piece) const
+template <typename Function>
+void Board::forEachAutomorphism(Function function) const
 {
-    for (int bitPlace = 0, bitPicker = 0b1; bitPlace < TRAIT_COUNT; bitPlace++, bitPicker *= 2)
+    for (int symmetry = 0; symmetry < SYMMETRY_COUNT; symmetry++)
     {
-        bool pickedBitValue = (piece & bitPicker) > 0;
-        if (terminatorPlaceCount[bitPlace][pickedBitValue] > 0)
-            return true;
+        const SymmetryImage& image = symmetryImages[symmetry];
+        if (image.occupied != occupied)
+            continue;
+
+        PieceMap pieceMap;
+        auto callback = [&function, symmetry](const PieceMap& pieceMap) { function(symmetry, pieceMap); };
+        matchTraits(image, traitPlanes, 0, 0, pieceMap, callback);
     }
-    return false;
 }
 
-std::array<int, 2> Board::getTerminatingPlace(int terminatingPiece)
+SquareMask Board::getDistinctPlaces(int selectedPiece) const
 {
-    for (int rowIndex = 0; rowIndex < BOARD_ROWS; rowIndex++)
+    // symmetries that keep the position and the selected piece
+    int symmetries = 0;
+    forEachAutomorphism([&symmetries, selectedPiece](int symmetry, const PieceMap& pieceMap)
+        {
+            if (pieceMap.apply(selectedPiece) == selectedPiece)
+                symmetries |= 1 << symmetry;
+        });
+
+    // keep the smallest square of each orbit
+    const SquareMask emptySquares = static_cast<SquareMask>(~occupied);
+    SquareMask distinctPlaces = emptySquares;
+    for (SquareMask rest = emptySquares; rest != 0; rest &= rest - 1)
     {
-        for (int colIndex = 0; colIndex < BOARD_COLS; colIndex++)
+        const int square = countBits(static_cast<std::uint32_t>((rest & -rest) - 1));
+        for (int symmetry = 1; symmetry < SYMMETRY_COUNT; symmetry++)
         {
-            if (board[rowIndex][colIndex] == -1)
+            if ((symmetries & (1 << symmetry)) && SYMMETRY_SQUARES[symmetry][square] < square)
             {
-                set(rowIndex, colIndex, terminatingPiece);
-                if (m_isWinnerExist)
-                {
-                    set(rowIndex, colIndex, -1);
-                    return { rowIndex, colIndex };
-                }
-                set(rowIndex, colIndex, -1);
+                distinctPlaces &= ~(1u << square);
+                break;
             }
         }
     }
-    return { -1,-1 };
+    return distinctPlaces;
 }
 
-
-bool Board::isWinnerExist() const
-{
-    return m_isWinnerExist;
-}
-
-int Board::getFilledCount() const
+std::uint16_t Board::getDistinctPieces(std::uint16_t availablePieces) const
 {
-    return filledCount;
+    // keep the smallest piece of each orbit
+    std::uint16_t distinctPieces = availablePieces;
+    forEachAutomorphism([&distinctPieces, availablePieces](int, const PieceMap& pieceMap)
+        {
+            for (std::uint16_t rest = distinctPieces; rest != 0; rest &= rest - 1)
+            {
+                const int piece = countBits(static_cast<std::uint32_t>((rest & -rest) - 1));
+                const int image = pieceMap.apply(piece);
+                if (image < piece && (availablePieces & (1u << image)))
+                    distinctPieces &= ~(1u << piece);
+            }
+        });
+    return distinctPieces;
 }
-
@@ -1,40 +1,157 @@
 #pragma once
 #include <array>
-#include <bitset>
-#include <vector>
+#include <cstdint>
 constexpr int BOARD_ROWS = 4;
 constexpr int BOARD_COLS = 4;
+constexpr int SQUARE_COUNT = BOARD_ROWS * BOARD_COLS;
 constexpr int PIECE_COUNT = 16;
 constexpr int TRAIT_COUNT = 4;
+// 4 rows, 4 cols, 2 diagonals, 9 2x2 squares
+constexpr int WINNING_GROUP_COUNT = 19;
+// a square belongs to at most 1 row, 1 col, 1 diagonal, 4 2x2 squares
+constexpr int MAX_GROUPS_PER_SQUARE = 7;
+// 4 rotations, each optionally mirrored up-down
+constexpr int SYMMETRY_COUNT = 8;
+
+// one bit per square, bit index = row * BOARD_COLS + col
+using SquareMask = std::uint16_t;
+
+constexpr int countBits(std::uint32_t bits)
+{
+    bits = bits - ((bits >> 1) & 0x55555555u);
+    bits = (bits & 0x33333333u) + ((bits >> 2) & 0x33333333u);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0Fu;
+    return static_cast<int>((bits * 0x01010101u) >> 24);
+}
+
+constexpr SquareMask squareBit(int row, int col)
+{
+    return static_cast<SquareMask>(1u << (row * BOARD_COLS + col));
+}
+
+constexpr std::array<SquareMask, WINNING_GROUP_COUNT> makeWinningGroups()
+{
+    std::array<SquareMask, WINNING_GROUP_COUNT> groups{};
+    int groupIndex = 0;
+    for (int row = 0; row < BOARD_ROWS; row++)
+    {
+        SquareMask mask = 0;
+        for (int col = 0; col < BOARD_COLS; col++)
+            mask |= squareBit(row, col);
+        groups[groupIndex++] = mask;
+    }
+    for (int col = 0; col < BOARD_COLS; col++)
+    {
+        SquareMask mask = 0;
+        for (int row = 0; row < BOARD_ROWS; row++)
+            mask |= squareBit(row, col);
+        groups[groupIndex++] = mask;
+    }
+    SquareMask diagonal = 0;
+    SquareMask antiDiagonal = 0;
+    for (int i = 0; i < BOARD_ROWS; i++)
+    {
+        diagonal |= squareBit(i, i);
+        antiDiagonal |= squareBit(i, BOARD_COLS - 1 - i);
+    }
+    groups[groupIndex++] = diagonal;
+    groups[groupIndex++] = antiDiagonal;
+    for (int row = 0; row + 1 < BOARD_ROWS; row++)
+    {
+        for (int col = 0; col + 1 < BOARD_COLS; col++)
+        {
+            groups[groupIndex++] = squareBit(row, col) | squareBit(row + 1, col)
+                | squareBit(row, col + 1) | squareBit(row + 1, col + 1);
+        }
+    }
+    return groups;
+}
+
+inline constexpr std::array<SquareMask, WINNING_GROUP_COUNT> WINNING_GROUPS = makeWinningGroups();
+
+// winning groups through a square, indices into WINNING_GROUPS
+struct SquareGroups
+{
+    int count = 0;
+    std::array<int, MAX_GROUPS_PER_SQUARE> groups{};
+};
+
+constexpr std::array<SquareGroups, SQUARE_COUNT> makeSquareGroups()
+{
+    std::array<SquareGroups, SQUARE_COUNT> result{};
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        for (int groupIndex = 0; groupIndex < WINNING_GROUP_COUNT; groupIndex++)
+        {
+            if (WINNING_GROUPS[groupIndex] & (1u << square))
+            {
+                result[square].groups[result[square].count] = groupIndex;
+                result[square].count++;
+            }
+        }
+    }
+    return result;
+}
+
+inline constexpr std::array<SquareGroups, SQUARE_COUNT> SQUARE_GROUPS = makeSquareGroups();
+
+// the board seen through one of the board symmetries
+struct SymmetryImage
+{
+    SquareMask occupied = 0;
+    std::array<SquareMask, TRAIT_COUNT> traitPlanes{};
+};
+
+// how getNormalized moved a position into its canonical form.
+// moves stored with a canonical key are kept in the canonical form
+struct PieceMap;
+
+struct SymmetryTransform
+{
+    int symmetry = 0;
+    // every piece is XOR-ed with the anchor
+    int anchor = 0;
+    // traitOrder[canonicalTrait] : original trait
+    std::array<int, TRAIT_COUNT> traitOrder{ 0, 1, 2, 3 };
+
+    int toCanonicalSquare(int square) const;
+    int fromCanonicalSquare(int square) const;
+    int toCanonicalPiece(int piece) const;
+    int fromCanonicalPiece(int piece) const;
+};
 
-using Matrix = std::vector<std::vector<int>>;
 class Board
 {
 private:
     std::array<std::array<int, 2>, TRAIT_COUNT> terminatorPlaceCount{};
-    std::vector<std::vector<int>> board{ BOARD_ROWS, std::vector<int>(BOARD_COLS) };
+    // 4bit nibble per square, valid only where occupied bit is set
+    std::uint64_t pieces = 0;
+    SquareMask occupied = 0;
+    // traitPlanes[trait] : squares whose piece has 1 at the trait bit
+    std::array<SquareMask, TRAIT_COUNT> traitPlanes{};
     int filledCount = 0;
-    bool m_isWinnerExist = false;
-
-    static std::vector<std::vector<int>> copyRotateRight(const std::vector<std::vector<int>>& originalBoard);
-    static std::vector<std::vector<int>> copyMirrorUpDown(const std::vector<std::vector<int>>& originalBoard);
-    static int getBoardPlaced16Bit(const Matrix& board);
-    static std::vector<int> permutation4Bit(int original);
-    static void permutation4BitRecursive(std::bitset<4> current, int nextPlacedIndex, std::bitset<4> original, std::bitset<4> used, std::vector<int>& result);
-    static long long getCompactExpression(const std::bitset<17 * 5>& board);
-
-    void checkLines(int changedRow, int changedCol, int select);
-    bool check2x2(int changedRow, int changedCol, int dRow, int dCol, int select);
-    // called before board field change
-    void checkAddInLine(std::vector<int> line, int pieceToAdd);
-    // called before board field change
-    void checkRemoveInLine(std::vector<int> line, int pieceToRemove);
+    int winningGroupCount = 0;
+    // symmetryImages[symmetry] : occupied and traitPlanes moved by the symmetry, updated in set.
+    // only the geometric part of the canonical form, getNormalized does the rest per call
+    std::array<SymmetryImage, SYMMETRY_COUNT> symmetryImages{};
+
+    int getAt(int square) const;
+    // sign : -1 before the square changes, +1 after
+    void updateGroupState(int square, int sign);
+    // calls function(symmetry, pieceMap) for every board symmetry, trait permutation and trait XOR
+    // that map the position to itself
+    template <typename Function>
+    void forEachAutomorphism(Function function) const;
 
 public:
     Board();
     void print() const;
 
+    // same key for positions equal up to board symmetry, trait permutation and trait XOR.
+    // set keeps the 8 symmetry images, so they are not rebuilt here. each call still XORs the images with the
+    // smallest place flags by the anchor, sorts their trait planes and encodes the smallest one
     long long getNormalized(int select) const;
+    long long getNormalized(int select, SymmetryTransform& transform) const;
 
     int get(int row, int col) const;
     void setBoardFromStdin();
@@ -42,7 +159,24 @@ public:
 
     bool isFull() const;
     bool hasTerminatorTrait(int piece) const;
-    std::array<int, 2> getTerminatingPlace(int terminatingPiece);
+    // winning groups with 3 pieces sharing the value at the trait, the 4th square still empty
+    int getTerminatorGroupCount(int trait, int value) const;
+    std::array<int, 2> getTerminatingPlace(int terminatingPiece) const;
     bool isWinnerExist() const;
     int getFilledCount() const;
+    SquareMask getOccupied() const;
+    SquareMask getTraitPlane(int trait) const;
+
+    // move ordering hints
+    // lines through the square killed by the piece, minus trait values it turns into terminators
+    int getPlaceScore(int row, int col, int piece) const;
+    // empty squares where the piece makes no new terminator trait value
+    int getSafePlaceCount(int piece) const;
+
+    // symmetry pruned move generation : one representative per orbit under the automorphisms of the position.
+    // empty squares, for placing selectedPiece
+    SquareMask getDistinctPlaces(int selectedPiece) const;
+    // pieces of availablePieces (bit index = piece), which must be closed under the automorphisms,
+    // as the pieces not on the board are
+    std::uint16_t getDistinctPieces(std::uint16_t availablePieces) const;
 };
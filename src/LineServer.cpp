@@ -0,0 +1,175 @@
+#include "LineServer.h"
+
+#include <cstring>
+#include <iostream>
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // a request may end with \r\n
+    void trimLineEnd(std::string& line)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+    }
+
+#ifdef __linux__
+    constexpr int ACCEPT_RETRY_DELAY_MS = 100;
+
+    // the socket file, removed when SIGINT or SIGTERM stop the daemon
+    char listenedPath[sizeof(sockaddr_un::sun_path)] = {};
+
+    void removeSocketAndStop(int signalNumber)
+    {
+        unlink(listenedPath);
+        std::signal(signalNumber, SIG_DFL);
+        std::raise(signalNumber);
+    }
+
+    // false : the client is gone (EPIPE, reset). MSG_NOSIGNAL, so a client closing early does not kill the daemon by SIGPIPE
+    bool writeAll(int socket, const std::string& data)
+    {
+        std::size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t size = send(socket, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+            if (size < 0 && errno == EINTR)
+                continue;
+            if (size <= 0)
+                return false;
+            written += static_cast<std::size_t>(size);
+        }
+        return true;
+    }
+
+    // false : the handler asked to stop
+    bool serveClient(int client, const RequestHandler& handle, const ResponseSentHandler& onResponseSent)
+    {
+        std::string received;
+        char buffer[4096];
+        while (true)
+        {
+            const ssize_t size = read(client, buffer, sizeof(buffer));
+            if (size <= 0)
+                return true;
+            received.append(buffer, static_cast<std::size_t>(size));
+
+            std::size_t lineEnd;
+            while ((lineEnd = received.find('\n')) != std::string::npos)
+            {
+                std::string request = received.substr(0, lineEnd);
+                received.erase(0, lineEnd + 1);
+                trimLineEnd(request);
+                if (request.empty())
+                    continue;
+
+                std::string response;
+                const bool isServing = handle(request, response);
+                if (!writeAll(client, response + '\n'))
+                    return isServing;
+                if (!isServing)
+                    return false;
+                if (onResponseSent)
+                    onResponseSent();
+            }
+        }
+    }
+#endif
+}
+
+void serveStdio(const RequestHandler& handle, const ResponseSentHandler& onResponseSent)
+{
+    std::string request;
+    while (std::getline(std::cin, request))
+    {
+        trimLineEnd(request);
+        if (request.empty())
+            continue;
+
+        std::string response;
+        const bool isServing = handle(request, response);
+        std::cout << response << std::endl;
+        if (!isServing)
+            return;
+        if (onResponseSent)
+            onResponseSent();
+    }
+}
+
+bool serveUnixSocket(const std::string& path, const RequestHandler& handle, const ResponseSentHandler& onResponseSent)
+{
+#ifdef __linux__
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    std::strcpy(address.sun_path, path.c_str());
+
+    // a write to a closed client fails with EPIPE instead of stopping the process
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        return false;
+    // the socket file of a daemon that did not stop cleanly. any other file at the path is left alone
+    struct stat pathStatus;
+    if (lstat(path.c_str(), &pathStatus) == 0)
+    {
+        if (!S_ISSOCK(pathStatus.st_mode))
+        {
+            close(listener);
+            return false;
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 1) < 0)
+    {
+        close(listener);
+        return false;
+    }
+
+    std::strcpy(listenedPath, path.c_str());
+    std::signal(SIGINT, removeSocketAndStop);
+    std::signal(SIGTERM, removeSocketAndStop);
+
+    bool isServing = true;
+    bool isAccepting = true;
+    while (isServing && isAccepting)
+    {
+        const int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            // a signal, or a client gone before it was accepted
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // out of descriptors or memory : waits for some to be freed instead of spinning
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_DELAY_MS));
+                continue;
+            }
+            isAccepting = false;
+            continue;
+        }
+        isServing = serveClient(client, handle, onResponseSent);
+        close(client);
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    return isAccepting;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <functional>
+#include <string>
+
+// transport of the daemon mode : one request per line, one response line for each.
+// handle(request, response) answers a request, and returns false to stop serving after the response
+using RequestHandler = std::function<bool(const std::string& request, std::string& response)>;
+// called after each response is written, for work that must not delay it. may be empty
+using ResponseSentHandler = std::function<void()>;
+
+// requests from stdin, responses to stdout, until "quit" or the end of stdin
+void serveStdio(const RequestHandler& handle, const ResponseSentHandler& onResponseSent = {});
+// requests from the clients of a Unix socket created at path, one client at a time, until "quit".
+// false : the socket could not be opened, a file other than a socket is at path, or accepting failed for good
+bool serveUnixSocket(const std::string& path, const RequestHandler& handle, const ResponseSentHandler& onResponseSent = {});
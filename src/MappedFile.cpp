@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iterator>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+#ifdef __linux__
+    if (isMapped)
+        munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    isOpened = false;
+    isMapped = false;
+    buffer.clear();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+#ifdef __linux__
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) != 0)
+    {
+        ::close(file);
+        return false;
+    }
+    size = static_cast<std::size_t>(status.st_size);
+    if (size == 0)
+    {
+        // mmap fails on an empty file
+        ::close(file);
+        isOpened = true;
+        return true;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if (mapped == MAP_FAILED)
+    {
+        size = 0;
+        return false;
+    }
+    data = static_cast<const char*>(mapped);
+    isOpened = true;
+    isMapped = true;
+    return true;
+#else
+    std::ifstream file{ path, std::ios_base::binary };
+    if (!file)
+        return false;
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    isOpened = true;
+    return true;
+#endif
+}
+
+bool MappedFile::isOpen() const
+{
+    return isOpened;
+}
+
+const char* MappedFile::getData() const
+{
+    return data;
+}
+
+std::size_t MappedFile::getSize() const
+{
+    return size;
+}
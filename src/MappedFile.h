@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// a whole file in memory, read-only. mapped on Linux, so opening costs no reading and the pages
+// are shared by every process using the file. read into a buffer elsewhere
+class MappedFile
+{
+private:
+    const char* data = nullptr;
+    std::size_t size = 0;
+    bool isOpened = false;
+    bool isMapped = false;
+    std::vector<char> buffer;
+
+    void close();
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false : the file could not be opened, and nothing is mapped
+    bool open(const std::string& path);
+    bool isOpen() const;
+
+    const char* getData() const;
+    std::size_t getSize() const;
+};
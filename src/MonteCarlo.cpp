@@ -1,312 +1,982 @@
 #include "MonteCarlo.h"
 
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <algorithm>
 #include <future>
 #include <map>
+#include <new>
+#include <thread>
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 std::atomic<int> totalLoopCount = 0;
 
-MCTNodeSelected::MCTNodeSelected(int selectedPiece, const Board& currentBoard)
-    :selectedPiece(selectedPiece)
+// expansion is short, so threads spin instead of sleeping
+class ExpansionLockGuard
 {
-    for (int row = 0; row < BOARD_ROWS; row++)
+private:
+    std::atomic_flag& lock;
+public:
+    explicit ExpansionLockGuard(std::atomic_flag& lock)
+        :lock(lock)
     {
-        for (int col = 0; col < BOARD_COLS; col++)
+        while (lock.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    ~ExpansionLockGuard()
+    {
+        lock.clear(std::memory_order_release);
+    }
+};
+
+namespace
+{
+    // zero filled memory. pages are handed out lazily by the OS, so an unused budget costs nothing
+    void* allocateLargeMemory(std::size_t size)
+    {
+#ifdef __linux__
+        void* allocated = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (allocated == MAP_FAILED)
+            throw std::bad_alloc();
+        madvise(allocated, size, MADV_HUGEPAGE);
+#else
+        void* allocated = std::calloc(size, 1);
+        if (allocated == nullptr)
+            throw std::bad_alloc();
+#endif
+        return allocated;
+    }
+
+    void freeLargeMemory(void* allocated, std::size_t size)
+    {
+#ifdef __linux__
+        munmap(allocated, size);
+#else
+        std::free(allocated);
+#endif
+    }
+
+    // the whole pages of the range go back to the OS and read as zero when used again
+    void releaseLargeMemory(void* begin, std::size_t size)
+    {
+#ifdef __linux__
+        constexpr std::uintptr_t PAGE_SIZE = 4096;
+        const std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(begin) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        const std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(begin) + size) & ~(PAGE_SIZE - 1);
+        if (first < last)
+            madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+#endif
+    }
+}
+
+MCTNodeArena::MCTNodeArena(std::size_t memorySize)
+{
+    capacity = static_cast<std::uint32_t>(std::min<std::size_t>(memorySize / sizeof(MCTNode), NO_NODE - 1));
+    allocatedSize = static_cast<std::size_t>(capacity) * sizeof(MCTNode);
+    allocated = allocateLargeMemory(allocatedSize);
+    nodes = static_cast<MCTNode*>(allocated);
+}
+
+MCTNodeArena::~MCTNodeArena()
+{
+    freeLargeMemory(allocated, allocatedSize);
+}
+
+std::uint32_t MCTNodeArena::allocate(int count)
+{
+    const std::uint32_t first = size.fetch_add(count, std::memory_order_relaxed);
+    if (first > capacity || capacity - first < static_cast<std::uint32_t>(count))
+        return NO_NODE;
+    for (int i = 0; i < count; i++)
+        new (&nodes[first + i]) MCTNode();
+    return first;
+}
+
+void MCTNodeArena::clear()
+{
+    size = 0;
+}
+
+void MCTNodeArena::truncate(std::uint32_t size)
+{
+    const std::uint32_t usedSize = getSize();
+    if (size < usedSize)
+        releaseLargeMemory(&nodes[size], static_cast<std::size_t>(usedSize - size) * sizeof(MCTNode));
+    this->size = size;
+}
+
+std::uint32_t MCTNodeArena::getSize() const
+{
+    return std::min(size.load(std::memory_order_relaxed), capacity);
+}
+
+MCTGraph::MCTGraph(std::size_t memorySize)
+{
+    // half of the memory for the nodes, half for the edges
+    std::size_t slotCount = 1;
+    while (slotCount * 2 * sizeof(MCGNode) <= memorySize / 2 && slotCount * 2 < NO_NODE)
+        slotCount *= 2;
+    nodeMask = static_cast<std::uint32_t>(slotCount - 1);
+    allocatedNodesSize = slotCount * sizeof(MCGNode);
+    allocatedNodes = allocateLargeMemory(allocatedNodesSize);
+    nodes = static_cast<MCGNode*>(allocatedNodes);
+
+    edgeCapacity = static_cast<std::uint32_t>(std::min<std::size_t>(memorySize / 2 / sizeof(MCGEdge), NO_NODE - 1));
+    allocatedEdgesSize = static_cast<std::size_t>(edgeCapacity) * sizeof(MCGEdge);
+    allocatedEdges = allocateLargeMemory(allocatedEdgesSize);
+    edges = static_cast<MCGEdge*>(allocatedEdges);
+}
+
+MCTGraph::~MCTGraph()
+{
+    freeLargeMemory(allocatedNodes, allocatedNodesSize);
+    freeLargeMemory(allocatedEdges, allocatedEdgesSize);
+}
+
+std::uint32_t MCTGraph::findOrInsert(long long key)
+{
+    const std::uint64_t storedKey = static_cast<std::uint64_t>(key) + 1;
+    std::uint32_t slot = static_cast<std::uint32_t>(mixKey(static_cast<std::uint64_t>(key))) & nodeMask;
+    for (int probe = 0; probe < MAX_PROBE_COUNT; probe++, slot = (slot + 1) & nodeMask)
+    {
+        std::uint64_t slotKey = nodes[slot].key.load(std::memory_order_relaxed);
+        if (slotKey == 0)
         {
-            if (currentBoard.get(row, col) == -1)
+            if (nodeCount.load(std::memory_order_relaxed) >= (nodeMask + 1) / 4 * 3)
+                return NO_NODE;
+            // the rest of the node is still zero, so winning the key is enough to own the slot
+            if (nodes[slot].key.compare_exchange_strong(slotKey, storedKey, std::memory_order_relaxed))
             {
-                unexploredMoves.push_back({ row, col });
+                nodeCount.fetch_add(1, std::memory_order_relaxed);
+                return slot;
             }
         }
+        if (slotKey == storedKey)
+            return slot;
     }
+    return NO_NODE;
 }
 
-void MCTNodeSelected::expandChild(const std::array<int, 2>& selectedMove, const std::set<int>& availablePieces)
+std::uint32_t MCTGraph::allocateEdges(int count)
 {
-    children.emplace_back(selectedMove[0], selectedMove[1], availablePieces);
-    auto iterForRemove = std::find(unexploredMoves.begin(), unexploredMoves.end(), selectedMove);
-    unexploredMoves.erase(iterForRemove);
+    const std::uint32_t first = edgeCount.fetch_add(count, std::memory_order_relaxed);
+    if (first > edgeCapacity || edgeCapacity - first < static_cast<std::uint32_t>(count))
+        return NO_NODE;
+    return first;
 }
 
+std::uint32_t MCTGraph::getNodeCount() const
+{
+    return nodeCount.load(std::memory_order_relaxed);
+}
 
-MCTNodePlaced::MCTNodePlaced(int selectedRow, int selectedCol, const std::set<int>& availablePieces)
-    :selectedRow(selectedRow), selectedCol(selectedCol), unexploredMoves(availablePieces.begin(), availablePieces.end())
+MCSolver::MCSolver(const Board& board, PieceSet availablePieces)
+    : board(board), availablePieces(availablePieces)
 {
 }
 
-void MCTNodePlaced::expandChild(int selectedPiece, const Board& currentBoard)
+void MCSolver::setStopFlag(const std::atomic<bool>* stopFlag)
 {
-    children.emplace_back(selectedPiece, currentBoard);
-    auto iterForRemove = std::find(unexploredMoves.begin(), unexploredMoves.end(), selectedPiece);
-    unexploredMoves.erase(iterForRemove);
+    this->stopFlag = stopFlag;
+    if (exactSolver != nullptr)
+        exactSolver->setStopFlag(stopFlag);
 }
 
-MCSolver::MCSolver(const Board& board, const std::set<int>& availablePieces)
-    : board(board), availablePieces(availablePieces)
+bool MCSolver::isStopped() const
 {
+    return stopFlag != nullptr && stopFlag->load(std::memory_order_relaxed);
 }
 
-std::map<int, double> MCSolver::selectPiece()
+void MCSolver::setRave(int raveEquivalence)
 {
-    root = std::make_unique<MCTNodePlaced>(-1, -1, availablePieces);
-    MCTNodePlaced& rootCasted = dynamic_cast<MCTNodePlaced&>(*root);
+    this->raveEquivalence = raveEquivalence;
+}
+
+void MCSolver::setIterationLimit(int maxIterationCount)
+{
+    this->maxIterationCount = maxIterationCount;
+}
+
+void MCSolver::setExactSearch(std::shared_ptr<TranspositionTable> caches, int exactEmptyCount)
+{
+    exactSolver = std::make_unique<Solver>(board, availablePieces, std::move(caches));
+    exactSolver->setVerbose(false);
+    exactSolver->setStopFlag(stopFlag);
+    this->exactEmptyCount = exactEmptyCount;
+}
+
+bool MCSolver::isExactLeaf() const
+{
+    return exactSolver != nullptr && SQUARE_COUNT - board.getFilledCount() <= exactEmptyCount;
+}
+
+Utility MCSolver::solveSelect()
+{
+    exactSolver->init(board, availablePieces);
+    int bestPiece;
+    return exactSolver->solveSelect(bestPiece);
+}
+
+Utility MCSolver::solvePlace(int selectedPiece)
+{
+    exactSolver->init(board, availablePieces);
+    std::pair<int, int> bestPlace;
+    return exactSolver->solvePlace(selectedPiece, bestPlace);
+}
+
+int MCSolver::searchSelect(MCTNodeArena& arena, MCTNode& root)
+{
+    this->arena = &arena;
 
     int loopCount = 0;
-    using namespace std::chrono;
-    startTime = steady_clock::now();
-    // 5° piece  ߿
-    const int timeoutMs = board.getFilledCount() == 4 ? TIMEOUT_MS_LONG : TIMEOUT_MS;
-    while (duration_cast<milliseconds>(steady_clock::now() - startTime).count() < timeoutMs)
+    while (!isStopped() && loopCount < maxIterationCount && root.provenValue.load(std::memory_order_relaxed) == MCTNode::NOT_PROVEN)
     {
-        selectNodeAndBackpropagate(rootCasted);
+        iterationMoves = AmafMoves();
+        selectNodeAndBackpropagatePlaced(root);
         loopCount++;
     }
 
     totalLoopCount += loopCount;
+    return loopCount;
+}
 
-    std::map<int, double> result;
-    for (const auto& child : rootCasted.children)
+int MCSolver::searchPlace(MCTNodeArena& arena, MCTNode& root)
+{
+    this->arena = &arena;
+
+    int loopCount = 0;
+    while (!isStopped() && loopCount < maxIterationCount && root.provenValue.load(std::memory_order_relaxed) == MCTNode::NOT_PROVEN)
     {
-        result[child.selectedPiece] = child.playoutCount;
+        iterationMoves = AmafMoves();
+        selectNodeAndBackpropagateSelected(root);
+        loopCount++;
     }
 
-    return result;
+    totalLoopCount += loopCount;
+    return loopCount;
+}
+
+// the move is chosen by the playout count, but a proven win goes first and a proven loss last
+double getChildRank(const MCTNode& child)
+{
+    constexpr double PROVEN_RANK = 1e12;
+    const double playoutCount = child.playoutCount.load(std::memory_order_relaxed);
+    switch (child.provenValue.load(std::memory_order_relaxed))
+    {
+    case WIN:
+        return PROVEN_RANK + playoutCount;
+    case LOSS:
+        return playoutCount / PROVEN_RANK;
+    default:
+        return playoutCount;
+    }
 }
 
-std::map<std::array<int, 2>, double> MCSolver::placePiece(int selectedPiece)
+std::map<int, double> MCSolver::selectPiece(std::size_t arenaMemorySize)
 {
-    auto iterToRemove = availablePieces.find(selectedPiece);
-    availablePieces.erase(iterToRemove);
+    ownArena = std::make_unique<MCTNodeArena>(arenaMemorySize);
+    MCTNode& root = ownArena->get(ownArena->allocate(1));
 
-    root = std::make_unique<MCTNodeSelected>(selectedPiece, board);
-    MCTNodeSelected& rootCasted = dynamic_cast<MCTNodeSelected&>(*root);
+    searchSelect(*ownArena, root);
 
-    int loopCount = 0;
-    using namespace std::chrono;
-    startTime = steady_clock::now();
-    // 4° piece place ߿
-    const int timeoutMs = board.getFilledCount() == 3 ? TIMEOUT_MS_LONG : TIMEOUT_MS;
-    while (duration_cast<milliseconds>(steady_clock::now() - startTime).count() < timeoutMs)
+    std::map<int, double> result;
+    for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
     {
-        selectNodeAndBackpropagate(rootCasted);
-        loopCount++;
+        const MCTNode& child = ownArena->get(root.firstChild + i);
+        result[child.move] = getChildRank(child);
     }
 
-    totalLoopCount += loopCount;
+    return result;
+}
+
+std::map<std::array<int, 2>, double> MCSolver::placePiece(int selectedPiece, std::size_t arenaMemorySize)
+{
+    availablePieces.erase(selectedPiece);
+
+    ownArena = std::make_unique<MCTNodeArena>(arenaMemorySize);
+    MCTNode& root = ownArena->get(ownArena->allocate(1));
+    root.move = static_cast<std::int8_t>(selectedPiece);
+
+    searchPlace(*ownArena, root);
 
     std::map<std::array<int, 2>, double> result;
-    for (const auto& child : rootCasted.children)
+    for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
     {
-        result[{child.selectedRow, child.selectedCol}] = child.playoutCount;
+        const MCTNode& child = ownArena->get(root.firstChild + i);
+        result[{child.move / BOARD_COLS, child.move % BOARD_COLS}] = getChildRank(child);
     }
 
     return result;
 }
 
+template <typename Node>
+int MCSolver::beginVisit(Node& node)
+{
+    node.score.fetch_sub(VIRTUAL_LOSS, std::memory_order_relaxed);
+    return node.playoutCount.fetch_add(VIRTUAL_LOSS, std::memory_order_relaxed);
+}
+
+template <typename Node>
+void MCSolver::endVisit(Node& node, double playoutResult)
+{
+    node.score.fetch_add(static_cast<int>(playoutResult) + VIRTUAL_LOSS, std::memory_order_relaxed);
+    if constexpr (VIRTUAL_LOSS != 1)
+        node.playoutCount.fetch_add(1 - VIRTUAL_LOSS, std::memory_order_relaxed);
+}
+
+void MCSolver::generateSelectedNodeMoves(MCTNode& selectedNode)
+{
+    // Ī ĭ ϳ Ž
+    selectedNode.unexploredMoves = board.getDistinctPlaces(selectedNode.move);
+    selectedNode.firstChild = arena->allocate(countBits(selectedNode.unexploredMoves));
+    selectedNode.areMovesGenerated = true;
+}
+
+void MCSolver::generatePlacedNodeMoves(MCTNode& placedNode)
+{
+    // Ī piece ϳ Ž
+    PieceSet moves(board.getDistinctPieces(availablePieces.getMask()));
+    for (int piece : moves)
+    {
+        if (board.hasTerminatorTrait(piece))
+            moves.erase(piece);
+    }
+    placedNode.unexploredMoves = moves.getMask();
+    if (!moves.empty())
+        placedNode.firstChild = arena->allocate(moves.size());
+    placedNode.areMovesGenerated = true;
+}
+
+MCTNode* MCSolver::expandChild(MCTNode& node)
+{
+    if (node.unexploredMoves == 0 || node.firstChild == MCTNodeArena::NO_NODE)
+        return nullptr;
+
+    // squares are picked the same way as pieces
+    const int move = PieceSet(node.unexploredMoves).pickRandom(randomEngine);
+    node.unexploredMoves &= ~(1u << move);
+
+    const std::uint8_t childCount = node.childCount.load(std::memory_order_relaxed);
+    MCTNode& child = arena->get(node.firstChild + childCount);
+    child.move = static_cast<std::int8_t>(move);
+    node.childCount.store(childCount + 1, std::memory_order_release);
+    return &child;
+}
+
 constexpr double UCB1Constant = 1.41;
 double UCB1(double playoutCount, double score, double parentPlayoutCount)
 {
     return score / playoutCount + UCB1Constant * std::sqrt(std::log(parentPlayoutCount) / playoutCount);
 }
 
-double MCSolver::selectNodeAndBackpropagate(MCTNodeSelected& selectedNode)
+// only called once every move is expanded, so the child range no longer changes and is read without the lock
+MCTNode& MCSolver::selectMaxUCB1Child(MCTNode& node)
 {
-    double playoutResult;
-    if (selectedNode.playoutCount == 0)
+    const double parentPlayoutCount = node.playoutCount.load(std::memory_order_relaxed);
+    double maxUCB1 = std::numeric_limits<double>::lowest();
+    MCTNode* maxUCB1Child = &arena->get(node.firstChild);
+    const int childCount = node.childCount.load(std::memory_order_acquire);
+    for (int i = 0; i < childCount; i++)
     {
-        playoutResult = -playoutPlace(selectedNode.selectedPiece);
-        selectedNode.score += playoutResult;
-        selectedNode.playoutCount++;
-        return playoutResult;
+        MCTNode& child = arena->get(node.firstChild + i);
+        const signed char childProvenValue = child.provenValue.load(std::memory_order_relaxed);
+        if (childProvenValue == WIN)
+            return child;
+        if (childProvenValue == LOSS)
+            continue;
+        // expanded by another thread that has not reached it yet
+        const int childPlayoutCount = child.playoutCount.load(std::memory_order_relaxed);
+        if (childPlayoutCount == 0)
+            return child;
+
+        const int childScore = child.score.load(std::memory_order_relaxed);
+        double currentUCB1 = UCB1(childPlayoutCount, childScore, parentPlayoutCount);
+        const int amafCount = child.amafCount.load(std::memory_order_relaxed);
+        if (raveEquivalence > 0 && amafCount > 0)
+        {
+            // (1 - beta) * value + beta * AMAF value, the exploration term stays
+            const double beta = std::sqrt(raveEquivalence / (3.0 * childPlayoutCount + raveEquivalence));
+            const double amafValue = static_cast<double>(child.amafScore.load(std::memory_order_relaxed)) / amafCount;
+            currentUCB1 += beta * (amafValue - static_cast<double>(childScore) / childPlayoutCount);
+        }
+        if (currentUCB1 > maxUCB1)
+        {
+            maxUCB1 = currentUCB1;
+            maxUCB1Child = &child;
+        }
     }
+    return *maxUCB1Child;
+}
 
+// children expanded by other threads meanwhile may be missed, which only loses their share of this result
+void MCSolver::updateAmaf(MCTNode& node, std::uint16_t moves, double playoutResult)
+{
+    const int childCount = node.childCount.load(std::memory_order_acquire);
+    for (int i = 0; i < childCount; i++)
+    {
+        MCTNode& child = arena->get(node.firstChild + i);
+        if ((moves >> child.move) & 1)
+        {
+            child.amafCount.fetch_add(1, std::memory_order_relaxed);
+            child.amafScore.fetch_add(static_cast<int>(playoutResult), std::memory_order_relaxed);
+        }
+    }
+}
 
-    MCTNodePlaced* nextNode;
+void MCSolver::updateProvenValue(MCTNode& node, bool isSelectedNode)
+{
+    ExpansionLockGuard lock(node.expansionLock);
+    const int childCount = node.childCount.load(std::memory_order_relaxed);
+    if (childCount == 0)
+        return;
 
-    if (!selectedNode.unexploredMoves.empty())
+    signed char maxChildValue = UTILITY_MIN;
+    bool areAllChildrenProven = node.unexploredMoves == 0;
+    for (int i = 0; i < childCount; i++)
     {
-        std::vector<std::array<int, 2>> randomSelectResource(1);
-        std::sample(selectedNode.unexploredMoves.begin(), selectedNode.unexploredMoves.end(), randomSelectResource.begin(), 1, randomEngine);
-        std::array<int, 2> selectedMove = randomSelectResource[0];
-        selectedNode.expandChild(selectedMove, availablePieces);
-        nextNode = &selectedNode.children.back();
+        const signed char childValue = arena->get(node.firstChild + i).provenValue.load(std::memory_order_relaxed);
+        if (childValue == MCTNode::NOT_PROVEN)
+            areAllChildrenProven = false;
+        else
+            maxChildValue = std::max(maxChildValue, childValue);
     }
-    else
+
+    if (maxChildValue != WIN && !areAllChildrenProven)
+        return;
+    node.provenValue.store(static_cast<signed char>(isSelectedNode ? -maxChildValue : maxChildValue), std::memory_order_relaxed);
+}
+
+double MCSolver::selectNodeAndBackpropagateSelected(MCTNode& selectedNode)
+{
+    double playoutResult;
+    const int selectedPiece = selectedNode.move;
+    const int previousPlayoutCount = beginVisit(selectedNode);
+    const signed char provenValue = selectedNode.provenValue.load(std::memory_order_relaxed);
+    if (provenValue != MCTNode::NOT_PROVEN)
+    {
+        playoutResult = provenValue;
+        endVisit(selectedNode, playoutResult);
+        return playoutResult;
+    }
+    if (previousPlayoutCount == 0)
     {
-        double maxUCB1 = std::numeric_limits<double>::lowest();
-        MCTNodePlaced* maxUCB1Child = nullptr;
-        for (auto& child : selectedNode.children)
+        if (isExactLeaf())
         {
-            double currentUCB1 = UCB1(child.playoutCount, child.score, selectedNode.playoutCount);
-            if (currentUCB1 > maxUCB1)
-            {
-                maxUCB1 = currentUCB1;
-                maxUCB1Child = &child;
-            }
+            playoutResult = -solvePlace(selectedPiece);
+            // an interrupted search proves nothing
+            if (isStopped())
+                playoutResult = 0;
+            else
+                selectedNode.provenValue.store(static_cast<signed char>(playoutResult), std::memory_order_relaxed);
+        }
+        else
+        {
+            playoutResult = -playoutPlace(selectedPiece);
         }
-        nextNode = maxUCB1Child;
+        endVisit(selectedNode, playoutResult);
+        return playoutResult;
     }
 
-    board.set(nextNode->selectedRow, nextNode->selectedCol, selectedNode.selectedPiece);
-    playoutResult = -selectNodeAndBackpropagate(*nextNode);
-    board.set(nextNode->selectedRow, nextNode->selectedCol, -1);
+    MCTNode* nextNode;
+    {
+        ExpansionLockGuard lock(selectedNode.expansionLock);
+        if (!selectedNode.areMovesGenerated)
+            generateSelectedNodeMoves(selectedNode);
+        nextNode = expandChild(selectedNode);
+    }
+
+    // arena   playout 
+    if (nextNode == nullptr && selectedNode.childCount.load(std::memory_order_acquire) == 0)
+    {
+        playoutResult = -playoutPlace(selectedPiece);
+        endVisit(selectedNode, playoutResult);
+        return playoutResult;
+    }
+    if (nextNode == nullptr)
+        nextNode = &selectMaxUCB1Child(selectedNode);
+
+    const int row = nextNode->move / BOARD_COLS;
+    const int col = nextNode->move % BOARD_COLS;
+    board.set(row, col, selectedPiece);
+    playoutResult = -selectNodeAndBackpropagatePlaced(*nextNode);
+    board.set(row, col, -1);
+    iterationMoves.addPlace(board.getFilledCount(), nextNode->move);
+    if (raveEquivalence > 0)
+        updateAmaf(selectedNode, iterationMoves.getPlacedSquares(board.getFilledCount()), -playoutResult);
+    if (nextNode->provenValue.load(std::memory_order_relaxed) != MCTNode::NOT_PROVEN)
+        updateProvenValue(selectedNode, true);
 
-    selectedNode.score += playoutResult;
-    selectedNode.playoutCount++;
+    endVisit(selectedNode, playoutResult);
     return playoutResult;
 }
 
-double MCSolver::selectNodeAndBackpropagate(MCTNodePlaced& selectedNode)
+double MCSolver::selectNodeAndBackpropagatePlaced(MCTNode& placedNode)
 {
     double playoutResult;
+    const int previousPlayoutCount = beginVisit(placedNode);
+    const signed char provenValue = placedNode.provenValue.load(std::memory_order_relaxed);
 
-    if (board.isWinnerExist())
+    if (provenValue != MCTNode::NOT_PROVEN)
+    {
+        playoutResult = provenValue;
+    }
+    else if (board.isWinnerExist())
     {
         playoutResult = 1;
+        placedNode.provenValue.store(WIN, std::memory_order_relaxed);
     }
     else if (board.isFull())
     {
         playoutResult = 0;
+        placedNode.provenValue.store(DRAW, std::memory_order_relaxed);
     }
-    else if (selectedNode.playoutCount == 0)
+    else if (previousPlayoutCount == 0)
     {
-        auto removeIter = std::remove_if(selectedNode.unexploredMoves.begin(), selectedNode.unexploredMoves.end(),
-            [this](int unexploredMove) {return board.hasTerminatorTrait(unexploredMove); });
-        selectedNode.unexploredMoves.erase(removeIter, selectedNode.unexploredMoves.end());
-
-        playoutResult = playoutSelect();
-    }
-    else if (selectedNode.unexploredMoves.empty() && selectedNode.children.empty())
-    {
-        // unexploredmove child    ִٸ,   ִ piece  terminator .
-        // ,  piece ص йϰ ȴ.
-        playoutResult = -1;
+        if (isExactLeaf())
+        {
+            playoutResult = solveSelect();
+            if (isStopped())
+                playoutResult = 0;
+            else
+                placedNode.provenValue.store(static_cast<signed char>(playoutResult), std::memory_order_relaxed);
+        }
+        else
+        {
+            playoutResult = playoutSelect();
+        }
     }
     else {
-        MCTNodeSelected* nextNode;
-        if (!selectedNode.unexploredMoves.empty())
-        {
-            std::vector<int> randomSelectResource(1);
-            std::sample(selectedNode.unexploredMoves.begin(), selectedNode.unexploredMoves.end(), randomSelectResource.begin(), 1, randomEngine);
-            int selectedMove = randomSelectResource[0];
-            selectedNode.expandChild(selectedMove, board);
-            nextNode = &selectedNode.children.back();
+        MCTNode* nextNode;
+        {
+            ExpansionLockGuard lock(placedNode.expansionLock);
+            if (!placedNode.areMovesGenerated)
+                generatePlacedNodeMoves(placedNode);
+            nextNode = expandChild(placedNode);
         }
-        else
+
+        if (nextNode == nullptr && placedNode.childCount.load(std::memory_order_acquire) == 0)
         {
-            // (!selectedNode.children.empty())
-            double maxUCB1 = std::numeric_limits<double>::lowest();
-            MCTNodeSelected* maxUCB1Child = nullptr;
-            for (auto& child : selectedNode.children)
+            if (placedNode.firstChild == MCTNodeArena::NO_NODE)
             {
-                double currentUCB1 = UCB1(child.playoutCount, child.score, selectedNode.playoutCount);
-                if (currentUCB1 > maxUCB1)
-                {
-                    maxUCB1 = currentUCB1;
-                    maxUCB1Child = &child;
-                }
+                // arena   playout 
+                playoutResult = playoutSelect();
+            }
+            else
+            {
+                //   ִ piece ٸ,  piece  terminator .
+                // ,  piece ص йϰ ȴ.
+                playoutResult = -1;
+                placedNode.provenValue.store(LOSS, std::memory_order_relaxed);
             }
-            nextNode = maxUCB1Child;
         }
+        else
+        {
+            if (nextNode == nullptr)
+                nextNode = &selectMaxUCB1Child(placedNode);
 
-        auto iterToRemove = availablePieces.find(nextNode->selectedPiece);
-        availablePieces.erase(iterToRemove);
-        playoutResult = selectNodeAndBackpropagate(*nextNode);
-        availablePieces.insert(nextNode->selectedPiece);
+            availablePieces.erase(nextNode->move);
+            playoutResult = selectNodeAndBackpropagateSelected(*nextNode);
+            availablePieces.insert(nextNode->move);
+            iterationMoves.addSelect(board.getFilledCount(), nextNode->move);
+            if (raveEquivalence > 0)
+                updateAmaf(placedNode, iterationMoves.getSelectedPieces(board.getFilledCount()), playoutResult);
+            if (nextNode->provenValue.load(std::memory_order_relaxed) != MCTNode::NOT_PROVEN)
+                updateProvenValue(placedNode, false);
+        }
     }
 
-    selectedNode.score += playoutResult;
-    selectedNode.playoutCount++;
+    endVisit(placedNode, playoutResult);
     return playoutResult;
 }
 
-double MCSolver::playoutSelect()
+int MCSolver::searchSelectGraph(MCTGraph& graph, std::uint32_t root)
 {
-    if (board.isWinnerExist())
-        return 1;
-    if (board.isFull())
-        return 0;
+    this->graph = &graph;
+
+    int loopCount = 0;
+    while (!isStopped())
+    {
+        selectNodeAndBackpropagatePlacedGraph(root);
+        loopCount++;
+    }
+
+    totalLoopCount += loopCount;
+    return loopCount;
+}
+
+int MCSolver::searchPlaceGraph(MCTGraph& graph, std::uint32_t root, int selectedPiece)
+{
+    this->graph = &graph;
+
+    int loopCount = 0;
+    while (!isStopped())
+    {
+        selectNodeAndBackpropagateSelectedGraph(root, selectedPiece);
+        loopCount++;
+    }
+
+    totalLoopCount += loopCount;
+    return loopCount;
+}
 
-    std::vector<int> nonTerminatorPieces;
-    for (int piece : availablePieces)
+void MCSolver::generateSelectedGraphMoves(MCGNode& selectedNode, int selectedPiece, const SymmetryTransform& transform)
+{
+    // Ī ĭ ϳ Ž
+    PieceSet moves;
+    for (int square : PieceSet(board.getDistinctPlaces(selectedPiece)))
+        moves.insert(transform.toCanonicalSquare(square));
+    selectedNode.unexploredMoves = moves.getMask();
+    selectedNode.firstEdge = graph->allocateEdges(moves.size());
+    selectedNode.areMovesGenerated = true;
+}
+
+void MCSolver::generatePlacedGraphMoves(MCGNode& placedNode, const SymmetryTransform& transform)
+{
+    // Ī piece ϳ Ž
+    PieceSet moves;
+    for (int piece : PieceSet(board.getDistinctPieces(availablePieces.getMask())))
     {
         if (!board.hasTerminatorTrait(piece))
+            moves.insert(transform.toCanonicalPiece(piece));
+    }
+    placedNode.unexploredMoves = moves.getMask();
+    if (!moves.empty())
+        placedNode.firstEdge = graph->allocateEdges(moves.size());
+    placedNode.areMovesGenerated = true;
+}
+
+template <typename ChildKeyOf>
+std::uint32_t MCSolver::expandEdge(MCGNode& node, const SymmetryTransform& transform, bool isPlace, ChildKeyOf childKeyOf)
+{
+    if (node.unexploredMoves == 0 || node.firstEdge == MCTGraph::NO_NODE)
+        return MCTGraph::NO_NODE;
+
+    const int move = PieceSet(node.unexploredMoves).pickRandom(randomEngine);
+    const int boardMove = isPlace ? transform.fromCanonicalSquare(move) : transform.fromCanonicalPiece(move);
+    const std::uint32_t child = graph->findOrInsert(childKeyOf(boardMove));
+    // the graph is full, the move is tried again later
+    if (child == MCTGraph::NO_NODE)
+        return MCTGraph::NO_NODE;
+    node.unexploredMoves &= ~(1u << move);
+
+    // moves of different orbits can still reach the same position
+    for (int i = 0; i < node.edgeCount; i++)
+    {
+        if (graph->getEdge(node.firstEdge + i).child == child)
+            return node.firstEdge + i;
+    }
+
+    const std::uint32_t edgeIndex = node.firstEdge + node.edgeCount;
+    MCGEdge& edge = graph->getEdge(edgeIndex);
+    edge.child = child;
+    edge.move = static_cast<std::int8_t>(move);
+    node.edgeCount++;
+    return edgeIndex;
+}
+
+// a child reached through other parents counts those visits too, its average stays the value of the position
+std::uint32_t MCSolver::selectMaxUCB1Edge(MCGNode& node)
+{
+    const double parentPlayoutCount = node.playoutCount.load(std::memory_order_relaxed);
+    double maxUCB1 = std::numeric_limits<double>::lowest();
+    std::uint32_t maxUCB1Edge = node.firstEdge;
+    for (int i = 0; i < node.edgeCount; i++)
+    {
+        const MCGNode& child = graph->getNode(graph->getEdge(node.firstEdge + i).child);
+        const int childPlayoutCount = child.playoutCount.load(std::memory_order_relaxed);
+        if (childPlayoutCount == 0)
+            return node.firstEdge + i;
+
+        double currentUCB1 = UCB1(childPlayoutCount, child.score.load(std::memory_order_relaxed), parentPlayoutCount);
+        if (currentUCB1 > maxUCB1)
         {
-            nonTerminatorPieces.push_back(piece);
+            maxUCB1 = currentUCB1;
+            maxUCB1Edge = node.firstEdge + i;
         }
     }
+    return maxUCB1Edge;
+}
 
-    if (nonTerminatorPieces.empty())
-        return -1;
+double MCSolver::selectNodeAndBackpropagateSelectedGraph(std::uint32_t selectedNodeIndex, int selectedPiece)
+{
+    MCGNode& selectedNode = graph->getNode(selectedNodeIndex);
+    double playoutResult;
+    if (beginVisit(selectedNode) == 0)
+    {
+        playoutResult = -playoutPlace(selectedPiece);
+        endVisit(selectedNode, playoutResult);
+        return playoutResult;
+    }
 
-    std::sample(nonTerminatorPieces.begin(), nonTerminatorPieces.end(), nonTerminatorPieces.begin(), 1, randomEngine);
-    auto removeIter = std::find(availablePieces.begin(), availablePieces.end(), nonTerminatorPieces[0]);
-    availablePieces.erase(removeIter);
-    double result = -playoutPlace(nonTerminatorPieces[0]);
-    availablePieces.insert(nonTerminatorPieces[0]);
-    return result;
+    // the moves of the node are kept in its canonical form, the transform brings them to this board
+    SymmetryTransform transform;
+    board.getNormalized(selectedPiece, transform);
+    auto childKeyOf = [this, selectedPiece](int square)
+    {
+        board.set(square / BOARD_COLS, square % BOARD_COLS, selectedPiece);
+        const long long key = board.getNormalized(-1);
+        board.set(square / BOARD_COLS, square % BOARD_COLS, -1);
+        return key;
+    };
+
+    std::uint32_t edgeIndex;
+    bool hasEdge;
+    {
+        ExpansionLockGuard lock(selectedNode.expansionLock);
+        if (!selectedNode.areMovesGenerated)
+            generateSelectedGraphMoves(selectedNode, selectedPiece, transform);
+        edgeIndex = expandEdge(selectedNode, transform, true, childKeyOf);
+        hasEdge = selectedNode.edgeCount != 0;
+        // the graph is full : the edges can still change, so choose while holding the lock
+        if (edgeIndex == MCTGraph::NO_NODE && hasEdge && selectedNode.unexploredMoves != 0)
+            edgeIndex = selectMaxUCB1Edge(selectedNode);
+    }
+
+    // graph   playout 
+    if (!hasEdge)
+    {
+        playoutResult = -playoutPlace(selectedPiece);
+        endVisit(selectedNode, playoutResult);
+        return playoutResult;
+    }
+    if (edgeIndex == MCTGraph::NO_NODE)
+        edgeIndex = selectMaxUCB1Edge(selectedNode);
+
+    const MCGEdge& edge = graph->getEdge(edgeIndex);
+    const int square = transform.fromCanonicalSquare(edge.move);
+    board.set(square / BOARD_COLS, square % BOARD_COLS, selectedPiece);
+    playoutResult = -selectNodeAndBackpropagatePlacedGraph(edge.child);
+    board.set(square / BOARD_COLS, square % BOARD_COLS, -1);
+
+    endVisit(selectedNode, playoutResult);
+    return playoutResult;
+}
+
+double MCSolver::selectNodeAndBackpropagatePlacedGraph(std::uint32_t placedNodeIndex)
+{
+    MCGNode& placedNode = graph->getNode(placedNodeIndex);
+    double playoutResult;
+    const int previousPlayoutCount = beginVisit(placedNode);
+
+    if (board.isWinnerExist())
+    {
+        playoutResult = 1;
+    }
+    else if (board.isFull())
+    {
+        playoutResult = 0;
+    }
+    else if (previousPlayoutCount == 0)
+    {
+        playoutResult = playoutSelect();
+    }
+    else {
+        SymmetryTransform transform;
+        board.getNormalized(-1, transform);
+        auto childKeyOf = [this](int piece) { return board.getNormalized(piece); };
+
+        std::uint32_t edgeIndex;
+        bool hasEdge;
+        bool isGraphFull;
+        {
+            ExpansionLockGuard lock(placedNode.expansionLock);
+            if (!placedNode.areMovesGenerated)
+                generatePlacedGraphMoves(placedNode, transform);
+            edgeIndex = expandEdge(placedNode, transform, false, childKeyOf);
+            hasEdge = placedNode.edgeCount != 0;
+            isGraphFull = placedNode.firstEdge == MCTGraph::NO_NODE || placedNode.unexploredMoves != 0;
+            if (edgeIndex == MCTGraph::NO_NODE && hasEdge && placedNode.unexploredMoves != 0)
+                edgeIndex = selectMaxUCB1Edge(placedNode);
+        }
+
+        if (!hasEdge)
+        {
+            // graph   playout .
+            // ƴ϶  piece  terminator ̹Ƿ,  piece ص йϰ ȴ.
+            playoutResult = isGraphFull ? playoutSelect() : -1;
+        }
+        else
+        {
+            if (edgeIndex == MCTGraph::NO_NODE)
+                edgeIndex = selectMaxUCB1Edge(placedNode);
+
+            const MCGEdge& edge = graph->getEdge(edgeIndex);
+            const int piece = transform.fromCanonicalPiece(edge.move);
+            availablePieces.erase(piece);
+            playoutResult = selectNodeAndBackpropagateSelectedGraph(edge.child, piece);
+            availablePieces.insert(piece);
+        }
+    }
+
+    endVisit(placedNode, playoutResult);
+    return playoutResult;
+}
+
+double MCSolver::playoutSelect()
+{
+    Playout playout(board, availablePieces);
+    const double playoutResult = playout.playSelect(playoutRandom);
+    iterationMoves = playout.getMoves();
+    return playoutResult;
 }
 
 double MCSolver::playoutPlace(int selectedPiece)
 {
-    std::vector<std::array<int, 2>> emptyPlaces;
-    for (int row = 0; row < BOARD_ROWS; row++)
+    Playout playout(board, availablePieces);
+    const double playoutResult = playout.playPlace(selectedPiece, playoutRandom);
+    iterationMoves = playout.getMoves();
+    return playoutResult;
+}
+
+
+namespace
+{
+    // the last select and place searched by the MCTS decide the positions the negamax starts from
+    int getMoveTimeMs(int moveTimeMs, int ply)
+    {
+        if (moveTimeMs > 0)
+            return moveTimeMs;
+        const bool isImportantMove = ply >= NEGAMAX_START_DEPTH - 2 && ply < NEGAMAX_START_DEPTH;
+        return isImportantMove ? TimeManager::DEFAULT_IMPORTANT_MOVE_TIME_MS : TimeManager::DEFAULT_MOVE_TIME_MS;
+    }
+
+    // for a search stopped before its first iteration ended, which has no move
+    std::array<int, 2> pickRandomPlace(const Board& board)
+    {
+        std::mt19937 randomEngine{ std::random_device{}() };
+        const int square = PieceSet(static_cast<std::uint16_t>(~board.getOccupied())).pickRandom(randomEngine);
+        return { square / BOARD_COLS, square % BOARD_COLS };
+    }
+
+    // one solver per worker of the shared pool
+    int getSearchThreadCount()
+    {
+        return ThreadPool::getShared().getThreadCount();
+    }
+
+    // runs search(solver) for every solver on the shared pool. the calling thread asks the time manager
+    // every TimeManager::CHECK_INTERVAL_MS, with readProgress() from the root, whether to stop them
+    template <typename Search, typename ReadProgress>
+    void runSearch(std::vector<MCSolver>& solvers, TimeManager& timeManager, Search search, ReadProgress readProgress)
+    {
+        std::atomic<bool> stopFlag = false;
+        std::atomic<int> runningCount = static_cast<int>(solvers.size());
+        std::vector<std::future<void>> results;
+        results.reserve(solvers.size());
+        for (MCSolver& solver : solvers)
+        {
+            solver.setStopFlag(&stopFlag);
+            results.push_back(ThreadPool::getShared().submit([&search, &runningCount, &solver]
+                {
+                    search(solver);
+                    runningCount--;
+                }));
+        }
+
+        while (runningCount > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(TimeManager::CHECK_INTERVAL_MS));
+            if (timeManager.shouldStop(readProgress()))
+                break;
+        }
+        stopFlag = true;
+        for (auto& result : results)
+            result.get();
+
+        std::cerr << "totalLoopCount : " << totalLoopCount << '\n';
+        std::cerr << "spend time(ms) : " << timeManager.getElapsedMs() << '\n';
+    }
+
+    // moves are compared by rank, leads by playout count
+    SearchProgress readTreeProgress(MCTNodeArena& arena, MCTNode& root)
     {
-        for (int col = 0; col < BOARD_COLS; col++)
+        SearchProgress progress;
+        progress.iterationCount = root.playoutCount.load(std::memory_order_relaxed);
+        progress.isSolved = root.provenValue.load(std::memory_order_relaxed) != MCTNode::NOT_PROVEN;
+
+        ExpansionLockGuard lock(root.expansionLock);
+        double bestRank = 0;
+        for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
         {
-            if (board.get(row, col) == -1)
+            const MCTNode& child = arena.get(root.firstChild + i);
+            const int playoutCount = child.playoutCount.load(std::memory_order_relaxed);
+            if (getChildRank(child) > bestRank)
+            {
+                bestRank = getChildRank(child);
+                progress.bestMove = child.move;
+            }
+            if (playoutCount > progress.bestPlayoutCount)
+            {
+                progress.secondPlayoutCount = progress.bestPlayoutCount;
+                progress.bestPlayoutCount = playoutCount;
+            }
+            else if (playoutCount > progress.secondPlayoutCount)
             {
-                emptyPlaces.push_back({ row, col });
+                progress.secondPlayoutCount = playoutCount;
             }
         }
+        return progress;
     }
 
-    std::sample(emptyPlaces.begin(), emptyPlaces.end(), emptyPlaces.begin(), 1, randomEngine);
-    board.set(emptyPlaces[0][0], emptyPlaces[0][1], selectedPiece);
-    double result = playoutSelect();
-    board.set(emptyPlaces[0][0], emptyPlaces[0][1], -1);
-    return result;
-}
+    SearchProgress readGraphProgress(MCTGraph& graph, std::uint32_t root)
+    {
+        MCGNode& rootNode = graph.getNode(root);
+        SearchProgress progress;
+        progress.iterationCount = rootNode.playoutCount.load(std::memory_order_relaxed);
 
+        ExpansionLockGuard lock(rootNode.expansionLock);
+        for (int i = 0; i < rootNode.edgeCount; i++)
+        {
+            const MCGEdge& edge = graph.getEdge(rootNode.firstEdge + i);
+            const int playoutCount = graph.getNode(edge.child).playoutCount.load(std::memory_order_relaxed);
+            if (playoutCount > progress.bestPlayoutCount)
+            {
+                progress.secondPlayoutCount = progress.bestPlayoutCount;
+                progress.bestPlayoutCount = playoutCount;
+                progress.bestMove = edge.move;
+            }
+            else if (playoutCount > progress.secondPlayoutCount)
+            {
+                progress.secondPlayoutCount = playoutCount;
+            }
+        }
+        return progress;
+    }
+}
 
-int selectPieceParallel(const Board& board, const std::set<int>& availablePieces)
+int selectPieceParallel(const Board& board, PieceSet availablePieces, int moveTimeMs)
 {
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2));
+    auto caches = std::make_shared<TranspositionTable>(Solver::CACHE_MEMORY_SIZE);
     std::vector<MCSolver> MCSSolvers;
-    std::vector<std::thread> threads;
-    std::vector<std::future<std::map<int, double>>> futures;
-    MCSSolvers.reserve(MCTS_THREAD_COUNT);
-    threads.reserve(MCTS_THREAD_COUNT);
-    futures.reserve(MCTS_THREAD_COUNT);
-    for (int i = 0; i < MCTS_THREAD_COUNT; i++)
+    const int threadCount = getSearchThreadCount();
+    std::vector<std::map<int, double>> threadResults(threadCount);
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
     {
         MCSSolvers.emplace_back(board, availablePieces);
-        std::packaged_task<std::map<int, double>(MCSolver*)> task{ &MCSolver::selectPiece };
-        futures.emplace_back(task.get_future());
-        threads.emplace_back(std::move(task), &MCSSolvers.back());
+        MCSSolvers.back().setExactSearch(caches, MCTS_EXACT_EMPTY_COUNT);
     }
 
-    auto startTime = std::chrono::steady_clock::now();
+    // the trees are private to their threads, so only the time is managed
+    runSearch(MCSSolvers, timeManager, [&MCSSolvers, &threadResults, threadCount](MCSolver& solver)
+        {
+            threadResults[&solver - MCSSolvers.data()] = solver.selectPiece(MCTS_ARENA_MEMORY_SIZE / threadCount);
+        }, [] { return SearchProgress(); });
 
     std::map<int, double> threadResultsSum;
-    for (int i = 0; i < MCTS_THREAD_COUNT; i++)
+    for (const auto& threadResult : threadResults)
     {
-        auto threadResult = futures[i].get();
         for (const auto [piece, playoutCount] : threadResult)
-        {
-            if (threadResultsSum.find(piece) == threadResultsSum.end())
-                threadResultsSum[piece] = playoutCount;
-            else
-                threadResultsSum[piece] += playoutCount;
-        }
-        threads[i].join();
+            threadResultsSum[piece] += playoutCount;
     }
 
-    std::cerr << "totalLoopCount : " << totalLoopCount << '\n';
-    std::cerr << "spend time(ms) : " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << '\n';
-
     int bestPiece = -1;
     double maxVisitCount = 0;
     for (const auto& [piece, playoutCount] : threadResultsSum)
@@ -322,49 +992,38 @@ int selectPieceParallel(const Board& board, const std::set<int>& availablePieces
     if (bestPiece == -1)
     {
         std::mt19937 randomEngine{ std::random_device{}() };
-        std::array<int, 1> sampleOutput;
-        std::sample(availablePieces.begin(), availablePieces.end(), sampleOutput.begin(), 1, randomEngine);
-        bestPiece = sampleOutput[0];
+        bestPiece = availablePieces.pickRandom(randomEngine);
     }
 
     return bestPiece;
 }
 
-std::array<int, 2> placePieceParallel(const Board& board, const std::set<int>& availablePieces, int selectedPiece)
+std::array<int, 2> placePieceParallel(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs)
 {
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2 + 1));
+    auto caches = std::make_shared<TranspositionTable>(Solver::CACHE_MEMORY_SIZE);
     std::vector<MCSolver> MCSSolvers;
-    std::vector<std::thread> threads;
-    std::vector<std::future<std::map<std::array<int, 2>, double>>> futures;
-    MCSSolvers.reserve(MCTS_THREAD_COUNT);
-    threads.reserve(MCTS_THREAD_COUNT);
-    futures.reserve(MCTS_THREAD_COUNT);
-    for (int i = 0; i < MCTS_THREAD_COUNT; i++)
+    const int threadCount = getSearchThreadCount();
+    std::vector<std::map<std::array<int, 2>, double>> threadResults(threadCount);
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
     {
         MCSSolvers.emplace_back(board, availablePieces);
-        std::packaged_task<std::map<std::array<int, 2>, double>(MCSolver*, int)> task{ &MCSolver::placePiece };
-        futures.emplace_back(task.get_future());
-        threads.emplace_back(std::move(task), &MCSSolvers.back(), selectedPiece);
+        MCSSolvers.back().setExactSearch(caches, MCTS_EXACT_EMPTY_COUNT);
     }
 
-    auto startTime = std::chrono::steady_clock::now();
+    runSearch(MCSSolvers, timeManager, [&MCSSolvers, &threadResults, selectedPiece, threadCount](MCSolver& solver)
+        {
+            threadResults[&solver - MCSSolvers.data()] = solver.placePiece(selectedPiece, MCTS_ARENA_MEMORY_SIZE / threadCount);
+        }, [] { return SearchProgress(); });
 
     std::map<std::array<int, 2>, double> threadResultsSum;
-    for (int i = 0; i < MCTS_THREAD_COUNT; i++)
+    for (const auto& threadResult : threadResults)
     {
-        auto threadResult = futures[i].get();
         for (const auto [place, playoutCount] : threadResult)
-        {
-            if (threadResultsSum.find(place) == threadResultsSum.end())
-                threadResultsSum[place] = playoutCount;
-            else
-                threadResultsSum[place] += playoutCount;
-        }
-        threads[i].join();
+            threadResultsSum[place] += playoutCount;
     }
 
-    std::cerr << "totalLoopCount : " << totalLoopCount << '\n';
-    std::cerr << "spend time(ms) : " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << '\n';
-
     std::array<int, 2> bestPlace = { -1, -1 };
     double maxVisitCount = 0;
     for (const auto& [place, playoutCount] : threadResultsSum)
@@ -376,5 +1035,480 @@ std::array<int, 2> placePieceParallel(const Board& board, const std::set<int>& a
         }
     }
 
+    if (bestPlace[0] == -1)
+        bestPlace = pickRandomPlace(board);
+
+    return bestPlace;
+}
+
+int selectPieceSharedTree(const Board& board, PieceSet availablePieces, int moveTimeMs)
+{
+    MCTSEngine engine;
+    return engine.selectPiece(board, availablePieces, moveTimeMs);
+}
+
+std::array<int, 2> placePieceSharedTree(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs)
+{
+    MCTSEngine engine;
+    return engine.placePiece(board, availablePieces, selectedPiece, moveTimeMs);
+}
+
+MCTSEngine::MCTSEngine(std::size_t arenaMemorySize, std::shared_ptr<TranspositionTable> caches)
+    : arena(arenaMemorySize), caches(std::move(caches))
+{
+    if (this->caches == nullptr)
+        this->caches = std::make_shared<TranspositionTable>(Solver::CACHE_MEMORY_SIZE);
+}
+
+MCTSEngine::~MCTSEngine()
+{
+    stopPondering();
+}
+
+void MCTSEngine::startPondering(const Board& board, PieceSet availablePieces, int selectedPiece)
+{
+    stopPondering();
+    if (selectedPiece != -1)
+        availablePieces.erase(selectedPiece);
+    MCTNode& root = moveRoot(board, selectedPiece);
+
+    // without a time manager, the search ends when stopped, when the root is proven, or with playouts only once the arena is full
+    ponderStopFlag = false;
+    const int threadCount = getSearchThreadCount();
+    ponderSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        ponderSolvers.emplace_back(board, availablePieces);
+        ponderSolvers.back().setExactSearch(caches, MCTS_EXACT_EMPTY_COUNT);
+        ponderSolvers.back().setRave(raveEquivalence);
+        ponderSolvers.back().setStopFlag(&ponderStopFlag);
+    }
+    for (MCSolver& solver : ponderSolvers)
+    {
+        ponderResults.push_back(ThreadPool::getShared().submit([this, &root, &solver, selectedPiece]
+            {
+                if (selectedPiece == -1)
+                    solver.searchSelect(arena, root);
+                else
+                    solver.searchPlace(arena, root);
+            }));
+    }
+}
+
+void MCTSEngine::stopPondering()
+{
+    ponderStopFlag = true;
+    for (auto& result : ponderResults)
+        result.get();
+    ponderResults.clear();
+    ponderSolvers.clear();
+}
+
+void MCTSEngine::clear()
+{
+    stopPondering();
+    arena.truncate(0);
+    hasRoot = false;
+}
+
+void MCTSEngine::setRaveEquivalence(int raveEquivalence)
+{
+    this->raveEquivalence = raveEquivalence;
+}
+
+std::uint32_t MCTSEngine::getTreeSize() const
+{
+    return arena.getSize();
+}
+
+std::vector<MCTSMoveStatistics> MCTSEngine::getRootStatistics() const
+{
+    std::vector<MCTSMoveStatistics> statistics;
+    if (!hasRoot)
+        return statistics;
+    const MCTNode& root = arena.get(0);
+    for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
+    {
+        const MCTNode& child = arena.get(root.firstChild + i);
+        statistics.push_back({ child.move, child.playoutCount.load(std::memory_order_relaxed),
+            child.score.load(std::memory_order_relaxed), child.provenValue.load(std::memory_order_relaxed) });
+    }
+    return statistics;
+}
+
+std::uint32_t MCTSEngine::findNode(const Board& board, int selectedPiece, Board& treeBoard, int& treeSelectedPiece) const
+{
+    // squares filled since the root position
+    std::vector<int> newSquares;
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        const int rootPiece = rootBoard.get(square / BOARD_COLS, square % BOARD_COLS);
+        const int piece = board.get(square / BOARD_COLS, square % BOARD_COLS);
+        if (rootPiece != -1 && rootPiece != piece)
+            return MCTNodeArena::NO_NODE;
+        if (rootPiece == -1 && piece != -1)
+            newSquares.push_back(square);
+    }
+
+    // the moves are replayed on position, and each is matched to the child holding an equal canonical position
+    Board position = rootBoard;
+    int positionSelectedPiece = rootSelectedPiece;
+    treeBoard = rootBoard;
+    treeSelectedPiece = rootSelectedPiece;
+    std::uint32_t node = 0;
+    while (!newSquares.empty() || positionSelectedPiece != selectedPiece)
+    {
+        const bool isSelectedNode = positionSelectedPiece != -1;
+        if (isSelectedNode)
+        {
+            auto placed = std::find_if(newSquares.begin(), newSquares.end(), [&board, positionSelectedPiece](int square)
+                {
+                    return board.get(square / BOARD_COLS, square % BOARD_COLS) == positionSelectedPiece;
+                });
+            if (placed == newSquares.end())
+                return MCTNodeArena::NO_NODE;
+            position.set(*placed / BOARD_COLS, *placed % BOARD_COLS, positionSelectedPiece);
+            newSquares.erase(placed);
+            positionSelectedPiece = -1;
+        }
+        else if (newSquares.empty())
+        {
+            positionSelectedPiece = selectedPiece;
+        }
+        else if (newSquares.size() == 1)
+        {
+            positionSelectedPiece = board.get(newSquares[0] / BOARD_COLS, newSquares[0] % BOARD_COLS);
+        }
+        else
+        {
+            // several pieces were placed, so the order they were selected in is unknown
+            return MCTNodeArena::NO_NODE;
+        }
+        const long long key = position.getNormalized(positionSelectedPiece);
+
+        const MCTNode& parent = arena.get(node);
+        std::uint32_t next = MCTNodeArena::NO_NODE;
+        for (int i = 0; i < parent.childCount.load(std::memory_order_relaxed) && next == MCTNodeArena::NO_NODE; i++)
+        {
+            const MCTNode& child = arena.get(parent.firstChild + i);
+            Board childBoard = treeBoard;
+            int childSelectedPiece = child.move;
+            if (isSelectedNode)
+            {
+                childBoard.set(child.move / BOARD_COLS, child.move % BOARD_COLS, treeSelectedPiece);
+                childSelectedPiece = -1;
+            }
+            if (childBoard.getNormalized(childSelectedPiece) == key)
+            {
+                next = parent.firstChild + i;
+                treeBoard = childBoard;
+                treeSelectedPiece = childSelectedPiece;
+            }
+        }
+        if (next == MCTNodeArena::NO_NODE)
+            return MCTNodeArena::NO_NODE;
+        node = next;
+    }
+    return node;
+}
+
+void MCTSEngine::compactSubtree(std::uint32_t node, bool isSelectedNode,
+    const std::array<int, SQUARE_COUNT>& squareMap, const std::array<int, PIECE_COUNT>& pieceMap)
+{
+    // children are allocated in blocks after their parent, so moving the kept blocks down in the order
+    // of their index never overwrites a block not moved yet
+    struct ChildBlock
+    {
+        std::uint32_t first;
+        std::uint32_t count;
+        bool isSelectedNode;
+        std::uint32_t newFirst;
+    };
+    auto getBlockSize = [](const MCTNode& node)
+        {
+            if (!node.areMovesGenerated || node.firstChild == MCTNodeArena::NO_NODE)
+                return 0;
+            return node.childCount.load(std::memory_order_relaxed) + countBits(node.unexploredMoves);
+        };
+
+    std::vector<ChildBlock> blocks;
+    std::vector<std::pair<std::uint32_t, bool>> pending = { { node, isSelectedNode } };
+    while (!pending.empty())
+    {
+        const auto [index, isSelected] = pending.back();
+        pending.pop_back();
+        const MCTNode& current = arena.get(index);
+        const int blockSize = getBlockSize(current);
+        if (blockSize == 0)
+            continue;
+        blocks.push_back({ current.firstChild, static_cast<std::uint32_t>(blockSize), !isSelected, 0 });
+        for (int i = 0; i < current.childCount.load(std::memory_order_relaxed); i++)
+            pending.push_back({ current.firstChild + i, !isSelected });
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const ChildBlock& a, const ChildBlock& b) { return a.first < b.first; });
+
+    std::uint32_t size = 1;
+    for (ChildBlock& block : blocks)
+    {
+        block.newFirst = size;
+        size += block.count;
+    }
+
+    auto mapMoves = [](std::uint16_t moves, const auto& map)
+        {
+            std::uint16_t mapped = 0;
+            for (int move : PieceSet(moves))
+                mapped |= static_cast<std::uint16_t>(1u << map[move]);
+            return mapped;
+        };
+    // a selected node holds a piece and places on squares, a placed node holds a square and selects pieces
+    auto moveNode = [&](std::uint32_t to, std::uint32_t from, bool isSelected)
+        {
+            MCTNode& source = arena.get(from);
+            const int playoutCount = source.playoutCount.load(std::memory_order_relaxed);
+            const int score = source.score.load(std::memory_order_relaxed);
+            const int amafCount = source.amafCount.load(std::memory_order_relaxed);
+            const int amafScore = source.amafScore.load(std::memory_order_relaxed);
+            const signed char provenValue = source.provenValue.load(std::memory_order_relaxed);
+            std::uint32_t firstChild = source.firstChild;
+            if (getBlockSize(source) > 0)
+            {
+                firstChild = std::lower_bound(blocks.begin(), blocks.end(), firstChild,
+                    [](const ChildBlock& block, std::uint32_t first) { return block.first < first; })->newFirst;
+            }
+            const std::uint8_t childCount = source.childCount.load(std::memory_order_relaxed);
+            std::int8_t move = source.move;
+            if (move != -1)
+                move = static_cast<std::int8_t>(isSelected ? pieceMap[move] : squareMap[move]);
+            const std::uint16_t unexploredMoves = isSelected ? mapMoves(source.unexploredMoves, squareMap) : mapMoves(source.unexploredMoves, pieceMap);
+            const bool areMovesGenerated = source.areMovesGenerated;
+
+            MCTNode& target = *new (&arena.get(to)) MCTNode();
+            target.playoutCount.store(playoutCount, std::memory_order_relaxed);
+            target.score.store(score, std::memory_order_relaxed);
+            target.amafCount.store(amafCount, std::memory_order_relaxed);
+            target.amafScore.store(amafScore, std::memory_order_relaxed);
+            target.firstChild = firstChild;
+            target.childCount.store(childCount, std::memory_order_relaxed);
+            target.move = move;
+            target.unexploredMoves = unexploredMoves;
+            target.areMovesGenerated = areMovesGenerated;
+            target.provenValue.store(provenValue, std::memory_order_relaxed);
+        };
+
+    moveNode(0, node, isSelectedNode);
+    for (const ChildBlock& block : blocks)
+    {
+        for (std::uint32_t i = 0; i < block.count; i++)
+            moveNode(block.newFirst + i, block.first + i, block.isSelectedNode);
+    }
+    arena.truncate(size);
+}
+
+MCTNode& MCTSEngine::moveRoot(const Board& board, int selectedPiece)
+{
+    Board treeBoard;
+    int treeSelectedPiece;
+    const std::uint32_t node = hasRoot ? findNode(board, selectedPiece, treeBoard, treeSelectedPiece) : MCTNodeArena::NO_NODE;
+    if (node == MCTNodeArena::NO_NODE)
+    {
+        arena.truncate(0);
+        arena.allocate(1);
+        arena.get(0).move = static_cast<std::int8_t>(selectedPiece);
+    }
+    else
+    {
+        // the symmetry taking the position of the node to the position searched
+        SymmetryTransform treeTransform;
+        SymmetryTransform transform;
+        treeBoard.getNormalized(treeSelectedPiece, treeTransform);
+        board.getNormalized(selectedPiece, transform);
+        std::array<int, SQUARE_COUNT> squareMap;
+        std::array<int, PIECE_COUNT> pieceMap;
+        for (int square = 0; square < SQUARE_COUNT; square++)
+            squareMap[square] = transform.fromCanonicalSquare(treeTransform.toCanonicalSquare(square));
+        for (int piece = 0; piece < PIECE_COUNT; piece++)
+            pieceMap[piece] = transform.fromCanonicalPiece(treeTransform.toCanonicalPiece(piece));
+
+        compactSubtree(node, selectedPiece != -1, squareMap, pieceMap);
+        std::cerr << "reused nodes : " << arena.getSize() << ", playouts : " << arena.get(0).playoutCount << '\n';
+    }
+
+    hasRoot = true;
+    rootBoard = board;
+    rootSelectedPiece = selectedPiece;
+    return arena.get(0);
+}
+
+int MCTSEngine::selectPiece(const Board& board, PieceSet availablePieces, int moveTimeMs)
+{
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2));
+    stopPondering();
+    MCTNode& root = moveRoot(board, -1);
+    std::vector<MCSolver> MCSSolvers;
+    const int threadCount = getSearchThreadCount();
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        MCSSolvers.emplace_back(board, availablePieces);
+        MCSSolvers.back().setExactSearch(caches, MCTS_EXACT_EMPTY_COUNT);
+        MCSSolvers.back().setRave(raveEquivalence);
+    }
+
+    runSearch(MCSSolvers, timeManager, [this, &root](MCSolver& solver) { solver.searchSelect(arena, root); },
+        [this, &root] { return readTreeProgress(arena, root); });
+
+    int bestPiece = -1;
+    double maxRank = 0;
+    for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
+    {
+        const MCTNode& child = arena.get(root.firstChild + i);
+        if (getChildRank(child) > maxRank)
+        {
+            maxRank = getChildRank(child);
+            bestPiece = child.move;
+        }
+    }
+
+    // a root proven before it was expanded has no children to choose from, so it is solved again for the move
+    if (bestPiece == -1 && root.provenValue.load(std::memory_order_relaxed) != MCTNode::NOT_PROVEN)
+    {
+        Solver solver(board, availablePieces, caches);
+        bestPiece = solver.selectPieceParallel(ThreadPool::getShared().getThreadCount());
+    }
+
+    // terminator piece   -1 ϵǴ  
+    if (bestPiece == -1)
+    {
+        std::mt19937 randomEngine{ std::random_device{}() };
+        bestPiece = availablePieces.pickRandom(randomEngine);
+    }
+
+    return bestPiece;
+}
+
+std::array<int, 2> MCTSEngine::placePiece(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs)
+{
+    availablePieces.erase(selectedPiece);
+
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2 + 1));
+    stopPondering();
+    MCTNode& root = moveRoot(board, selectedPiece);
+    std::vector<MCSolver> MCSSolvers;
+    const int threadCount = getSearchThreadCount();
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        MCSSolvers.emplace_back(board, availablePieces);
+        MCSSolvers.back().setExactSearch(caches, MCTS_EXACT_EMPTY_COUNT);
+        MCSSolvers.back().setRave(raveEquivalence);
+    }
+
+    runSearch(MCSSolvers, timeManager, [this, &root](MCSolver& solver) { solver.searchPlace(arena, root); },
+        [this, &root] { return readTreeProgress(arena, root); });
+
+    std::array<int, 2> bestPlace = { -1, -1 };
+    double maxRank = 0;
+    for (int i = 0; i < root.childCount.load(std::memory_order_relaxed); i++)
+    {
+        const MCTNode& child = arena.get(root.firstChild + i);
+        if (getChildRank(child) > maxRank)
+        {
+            maxRank = getChildRank(child);
+            bestPlace = { child.move / BOARD_COLS, child.move % BOARD_COLS };
+        }
+    }
+
+    // a root proven before it was expanded has no children to choose from, so it is solved again for the move
+    if (bestPlace[0] == -1 && root.provenValue.load(std::memory_order_relaxed) != MCTNode::NOT_PROVEN)
+    {
+        availablePieces.insert(selectedPiece);
+        Solver solver(board, availablePieces, caches);
+        const auto place = solver.placePieceParallel(selectedPiece, ThreadPool::getShared().getThreadCount());
+        bestPlace = { place.first, place.second };
+    }
+
+    if (bestPlace[0] == -1)
+        bestPlace = pickRandomPlace(board);
+
+    return bestPlace;
+}
+
+int selectPieceGraph(const Board& board, PieceSet availablePieces, int moveTimeMs)
+{
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2));
+    MCTGraph graph(MCTS_GRAPH_MEMORY_SIZE);
+    SymmetryTransform transform;
+    const std::uint32_t root = graph.findOrInsert(board.getNormalized(-1, transform));
+    std::vector<MCSolver> MCSSolvers;
+    const int threadCount = getSearchThreadCount();
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+        MCSSolvers.emplace_back(board, availablePieces);
+
+    runSearch(MCSSolvers, timeManager, [&graph, root](MCSolver& solver) { solver.searchSelectGraph(graph, root); },
+        [&graph, root] { return readGraphProgress(graph, root); });
+    std::cerr << "graph nodes : " << graph.getNodeCount() << '\n';
+
+    int bestPiece = -1;
+    int maxVisitCount = 0;
+    const MCGNode& rootNode = graph.getNode(root);
+    for (int i = 0; i < rootNode.edgeCount; i++)
+    {
+        const MCGEdge& edge = graph.getEdge(rootNode.firstEdge + i);
+        const int playoutCount = graph.getNode(edge.child).playoutCount;
+        if (playoutCount > maxVisitCount)
+        {
+            maxVisitCount = playoutCount;
+            bestPiece = transform.fromCanonicalPiece(edge.move);
+        }
+    }
+
+    // terminator piece   -1 ϵǴ  
+    if (bestPiece == -1)
+    {
+        std::mt19937 randomEngine{ std::random_device{}() };
+        bestPiece = availablePieces.pickRandom(randomEngine);
+    }
+
+    return bestPiece;
+}
+
+std::array<int, 2> placePieceGraph(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs)
+{
+    availablePieces.erase(selectedPiece);
+
+    TimeManager timeManager(getMoveTimeMs(moveTimeMs, board.getFilledCount() * 2 + 1));
+    MCTGraph graph(MCTS_GRAPH_MEMORY_SIZE);
+    SymmetryTransform transform;
+    const std::uint32_t root = graph.findOrInsert(board.getNormalized(selectedPiece, transform));
+    std::vector<MCSolver> MCSSolvers;
+    const int threadCount = getSearchThreadCount();
+    MCSSolvers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+        MCSSolvers.emplace_back(board, availablePieces);
+
+    runSearch(MCSSolvers, timeManager, [&graph, root, selectedPiece](MCSolver& solver) { solver.searchPlaceGraph(graph, root, selectedPiece); },
+        [&graph, root] { return readGraphProgress(graph, root); });
+    std::cerr << "graph nodes : " << graph.getNodeCount() << '\n';
+
+    std::array<int, 2> bestPlace = { -1, -1 };
+    int maxVisitCount = 0;
+    const MCGNode& rootNode = graph.getNode(root);
+    for (int i = 0; i < rootNode.edgeCount; i++)
+    {
+        const MCGEdge& edge = graph.getEdge(rootNode.firstEdge + i);
+        const int playoutCount = graph.getNode(edge.child).playoutCount;
+        if (playoutCount > maxVisitCount)
+        {
+            maxVisitCount = playoutCount;
+            const int square = transform.fromCanonicalSquare(edge.move);
+            bestPlace = { square / BOARD_COLS, square % BOARD_COLS };
+        }
+    }
+
+    if (bestPlace[0] == -1)
+        bestPlace = pickRandomPlace(board);
+
     return bestPlace;
 }
@@ -1,40 +1,135 @@
 #pragma once
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <future>
+#include <limits>
 #include <map>
 #include <memory>
 #include <random>
-#include <set>
 #include <vector>
 #include "Board.h"
+#include "PieceSet.h"
+#include "negamax.h"
+#include "Playout.h"
+#include "TimeManager.h"
 
+// one node of the tree, 28 byte. the two kinds alternate with depth :
+// selected node : a piece was selected (move : the piece), children place it on a square.
+// placed node : a piece was placed (move : the square, -1 at the root), children select the next piece
 struct MCTNode
 {
-    double playoutCount = 0;
-    double score = 0;
-    virtual ~MCTNode() = default;
+    // several threads update the statistics of a shared tree.
+    // score counts wins - losses, so both fit in an int
+    std::atomic<int> playoutCount = 0;
+    std::atomic<int> score = 0;
+    // RAVE : iterations through the parent in which the move was played later by the same player, and their score
+    std::atomic<int> amafCount = 0;
+    std::atomic<int> amafScore = 0;
+    // children are childCount nodes in a row from firstChild, allocated together at the first expansion.
+    // the expansion stores childCount with release after the child is set, so the readers outside the lock load it with acquire
+    std::uint32_t firstChild = 0;
+    std::atomic<std::uint8_t> childCount = 0;
+    std::int8_t move = -1;
+    // squares or pieces not expanded yet, valid once areMovesGenerated
+    std::uint16_t unexploredMoves = 0;
+    // guards firstChild, childCount, unexploredMoves and areMovesGenerated while they change
+    std::atomic_flag expansionLock = ATOMIC_FLAG_INIT;
+    bool areMovesGenerated = false;
+    // MCTS-Solver : exact value for the player who made the move, once the subtree is solved
+    static constexpr signed char NOT_PROVEN = UTILITY_MAX;
+    std::atomic<signed char> provenValue = NOT_PROVEN;
 };
 
-struct MCTNodePlaced;
+// fixed size node storage of one search. nodes never move, and the tree is freed at once
+class MCTNodeArena
+{
+private:
+    void* allocated = nullptr;
+    std::size_t allocatedSize = 0;
+    MCTNode* nodes = nullptr;
+    std::uint32_t capacity = 0;
+    std::atomic<std::uint32_t> size = 0;
+
+public:
+    static constexpr std::uint32_t NO_NODE = 0xFFFFFFFF;
+
+    explicit MCTNodeArena(std::size_t memorySize);
+    ~MCTNodeArena();
+    MCTNodeArena(const MCTNodeArena&) = delete;
+    MCTNodeArena& operator=(const MCTNodeArena&) = delete;
 
-struct MCTNodeSelected :MCTNode
+    // count new nodes in a row, NO_NODE when the arena is full. any thread can call it
+    std::uint32_t allocate(int count);
+    MCTNode& get(std::uint32_t index) { return nodes[index]; }
+    const MCTNode& get(std::uint32_t index) const { return nodes[index]; }
+    // frees every node. call while no thread is searching
+    void clear();
+    // keeps the first size nodes, and gives the memory of the rest back to the OS. call while no thread is searching
+    void truncate(std::uint32_t size);
+    std::uint32_t getSize() const;
+};
+
+// graph search : one node per canonical position (Board::getNormalized), so the move orders and
+// symmetric moves reaching a position share its statistics. the position decides who is to move,
+// so a score is seen from the same side through every parent.
+// the memory of the graph starts zero filled, which is the empty state of both structs
+struct MCGNode
 {
-    int selectedPiece;
-    std::vector<MCTNodePlaced> children;
-    std::vector<std::array<int, 2>> unexploredMoves;
+    // canonical key + 1, 0 : empty slot
+    std::atomic<std::uint64_t> key;
+    std::atomic<int> playoutCount;
+    std::atomic<int> score;
+    // edges are edgeCount in a row from firstEdge, reserved together at the first expansion
+    std::uint32_t firstEdge;
+    std::uint8_t edgeCount;
+    // squares or pieces in the canonical form not expanded yet, valid once areMovesGenerated
+    std::uint16_t unexploredMoves;
+    std::atomic_flag expansionLock;
+    bool areMovesGenerated;
+};
 
-    MCTNodeSelected(int selectedPiece, const Board& currentBoard);
-    void expandChild(const std::array<int, 2>& selectedMove, const std::set<int>& availablePieces);
+struct MCGEdge
+{
+    std::uint32_t child;
+    // square or piece in the canonical form of the parent
+    std::int8_t move;
 };
 
-struct MCTNodePlaced :MCTNode
+// open addressing table of MCGNode keyed by the canonical key, and the edges between them.
+// nodes never move, so they are addressed by their slot
+class MCTGraph
 {
-    int selectedRow;
-    int selectedCol;
-    std::vector<MCTNodeSelected> children;
-    std::vector<int> unexploredMoves;
+private:
+    void* allocatedNodes = nullptr;
+    std::size_t allocatedNodesSize = 0;
+    MCGNode* nodes = nullptr;
+    std::uint32_t nodeMask = 0;
+    std::atomic<std::uint32_t> nodeCount = 0;
+    void* allocatedEdges = nullptr;
+    std::size_t allocatedEdgesSize = 0;
+    MCGEdge* edges = nullptr;
+    std::uint32_t edgeCapacity = 0;
+    std::atomic<std::uint32_t> edgeCount = 0;
+
+    // linear probing gets slow near full, so insertion stops at 3/4 of the slots
+    static constexpr int MAX_PROBE_COUNT = 64;
+
+public:
+    static constexpr std::uint32_t NO_NODE = 0xFFFFFFFF;
 
-    MCTNodePlaced(int selectedRow, int selectedCol, const std::set<int>& availablePieces);
-    void expandChild(int selectedPiece, const Board& currentBoard);
+    explicit MCTGraph(std::size_t memorySize);
+    ~MCTGraph();
+    MCTGraph(const MCTGraph&) = delete;
+    MCTGraph& operator=(const MCTGraph&) = delete;
+
+    // the node of the position, inserted if missing. NO_NODE when the table is full. any thread can call it
+    std::uint32_t findOrInsert(long long key);
+    // count edges in a row, NO_NODE when full
+    std::uint32_t allocateEdges(int count);
+    MCGNode& getNode(std::uint32_t index) { return nodes[index]; }
+    MCGEdge& getEdge(std::uint32_t index) { return edges[index]; }
+    std::uint32_t getNodeCount() const;
 };
 
 class MCSolver
@@ -42,26 +137,169 @@ class MCSolver
 private:
     static inline std::random_device randomDevice;
     std::mt19937 randomEngine{randomDevice()};
-    std::unique_ptr<MCTNode> root;
+    PlayoutRandom playoutRandom{ (std::uint64_t{ randomDevice() } << 32) | randomDevice() };
     Board board;
-    std::set<int> availablePieces;
-    static const int TIMEOUT_MS = 1000 * 5;
-    static const int TIMEOUT_MS_LONG = 1000 * 20;
-    std::chrono::steady_clock::time_point startTime;
+    PieceSet availablePieces;
+    // set by the thread running the time manager, checked once per iteration
+    const std::atomic<bool>* stopFlag = nullptr;
+    bool isStopped() const;
+    int maxIterationCount = std::numeric_limits<int>::max();
+    // the tree being searched, owned by this solver for selectPiece and placePiece
+    MCTNodeArena* arena = nullptr;
+    std::unique_ptr<MCTNodeArena> ownArena;
+
+    MCTGraph* graph = nullptr;
+    // evaluates new leaves with at most exactEmptyCount empty squares exactly, nullptr : playouts only
+    std::unique_ptr<Solver> exactSolver;
+    int exactEmptyCount = 0;
+
+    // a thread going through a node counts as a lost playout there until its result comes back,
+    // so the other threads of a shared tree spread to other children
+    static constexpr int VIRTUAL_LOSS = 1;
+    // 0 : plain UCB1
+    int raveEquivalence = 0;
+    // moves below the current node in this iteration, filled while it returns up the tree
+    AmafMoves iterationMoves;
+    // returns the playout count before the visit
+    template <typename Node>
+    static int beginVisit(Node& node);
+    template <typename Node>
+    static void endVisit(Node& node, double playoutResult);
+
+    // fills unexploredMoves and allocates the children, under the expansion lock
+    void generateSelectedNodeMoves(MCTNode& selectedNode);
+    void generatePlacedNodeMoves(MCTNode& placedNode);
+    // the new child, or nullptr when every move is expanded or the arena is full
+    MCTNode* expandChild(MCTNode& node);
+    MCTNode& selectMaxUCB1Child(MCTNode& node);
+    // credits the children whose move is in moves with the result for the player making them
+    void updateAmaf(MCTNode& node, std::uint16_t moves, double playoutResult);
+
+    bool isExactLeaf() const;
+    // exact value for the player to move
+    Utility solveSelect();
+    Utility solvePlace(int selectedPiece);
+    // proves the node from its children : a won child is enough, otherwise every move has to be proven.
+    // the children of a selected node are moves of the opponent, those of a placed node moves of the same player
+    void updateProvenValue(MCTNode& node, bool isSelectedNode);
+
+    // graph search counterparts. transform : from the board to the canonical form of the node
+    void generateSelectedGraphMoves(MCGNode& selectedNode, int selectedPiece, const SymmetryTransform& transform);
+    void generatePlacedGraphMoves(MCGNode& placedNode, const SymmetryTransform& transform);
+    // the edge expanded, or NO_NODE. childKeyOf(move on the board) : canonical key of the child
+    template <typename ChildKeyOf>
+    std::uint32_t expandEdge(MCGNode& node, const SymmetryTransform& transform, bool isPlace, ChildKeyOf childKeyOf);
+    // index of the edge
+    std::uint32_t selectMaxUCB1Edge(MCGNode& node);
 public:
-    MCSolver(const Board& board, const std::set<int>& availablePieces);
+    MCSolver(const Board& board, PieceSet availablePieces);
+    void setStopFlag(const std::atomic<bool>* stopFlag);
+    // MCTS-Solver leaves : exact search with caches shared by every MCSolver of the search
+    void setExactSearch(std::shared_ptr<TranspositionTable> caches, int exactEmptyCount);
+    // RAVE : UCB1 blends the value of a child with its AMAF value by the weight sqrt(k / (3 * playoutCount + k)),
+    // so the AMAF value counts as much as the own value at k playouts. 0 : off
+    void setRave(int raveEquivalence);
+    // stops a search after this many iterations of this MCSolver
+    void setIterationLimit(int maxIterationCount);
+
+    // root parallel : searches a tree of its own, and returns the playout count of each root child
+    std::map<int, double> selectPiece(std::size_t arenaMemorySize);
+    std::map<std::array<int, 2>, double> placePiece(int selectedPiece, std::size_t arenaMemorySize);
+
+    // runs iterations from root until stopped, until the iteration limit or until root is proven, the arena may be shared by several MCSolvers.
+    // root is a placed node for searchSelect, a selected node for searchPlace. returns the number of iterations
+    int searchSelect(MCTNodeArena& arena, MCTNode& root);
+    int searchPlace(MCTNodeArena& arena, MCTNode& root);
 
-    std::map<int, double> selectPiece();
-    std::map<std::array<int, 2>, double> placePiece(int selectedPiece);
+    double selectNodeAndBackpropagateSelected(MCTNode& selectedNode);
+    double selectNodeAndBackpropagatePlaced(MCTNode& placedNode);
 
-    double selectNodeAndBackpropagate(MCTNodeSelected& selectedNode);
-    double selectNodeAndBackpropagate(MCTNodePlaced& selectedNode);
+    // graph search from root, the node of the current board. the graph may be shared by several MCSolvers
+    int searchSelectGraph(MCTGraph& graph, std::uint32_t root);
+    int searchPlaceGraph(MCTGraph& graph, std::uint32_t root, int selectedPiece);
+    double selectNodeAndBackpropagateSelectedGraph(std::uint32_t selectedNode, int selectedPiece);
+    double selectNodeAndBackpropagatePlacedGraph(std::uint32_t placedNode);
 
     double playoutSelect();
     double playoutPlace(int selectedPiece);
 };
 
 extern std::atomic<int> totalLoopCount;
-const int MCTS_THREAD_COUNT = 24;
-int selectPieceParallel(const Board& board, const std::set<int>& availablePieces);
-std::array<int, 2> placePieceParallel(const Board& board, const std::set<int>& availablePieces, int selectedPiece);
+// tree searches solve new leaves with this many empty squares or less with negamax
+constexpr int MCTS_EXACT_EMPTY_COUNT = 9;
+// shared by all threads of one search, 28 byte per node
+constexpr std::size_t MCTS_ARENA_MEMORY_SIZE = 1024 * 1024 * 1024;
+// moveTimeMs : the most the move may take, the search often stops earlier (TimeManager).
+// 0 uses TimeManager::DEFAULT_MOVE_TIME_MS, or DEFAULT_IMPORTANT_MOVE_TIME_MS for the last select and place before NEGAMAX_START_DEPTH
+// the searches run one MCSolver on each worker of ThreadPool::getShared()
+// root parallel : independent trees, root visit counts are summed
+int selectPieceParallel(const Board& board, PieceSet availablePieces, int moveTimeMs = 0);
+std::array<int, 2> placePieceParallel(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs = 0);
+// tree parallel : the threads search one shared tree, by an MCTSEngine used for one move
+int selectPieceSharedTree(const Board& board, PieceSet availablePieces, int moveTimeMs = 0);
+std::array<int, 2> placePieceSharedTree(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs = 0);
+
+// a move of the root after a search
+struct MCTSMoveStatistics
+{
+    int move;
+    int playoutCount;
+    int score;
+    // MCTNode::NOT_PROVEN, or the exact value for the player making the move
+    signed char provenValue;
+};
+
+// tree parallel search that keeps its tree through the moves of a game, for a process playing several moves.
+// a search starts from the node of the new position in the previous tree, found by following the moves played since.
+// that subtree is moved to the front of the arena and the rest of the tree is freed
+class MCTSEngine
+{
+private:
+    MCTNodeArena arena;
+    std::shared_ptr<TranspositionTable> caches;
+    // the position of the root, node 0 of the arena. rootSelectedPiece -1 : the root is a placed node
+    bool hasRoot = false;
+    Board rootBoard;
+    int rootSelectedPiece = -1;
+    int raveEquivalence = 0;
+    // the search running between the calls, on the workers of the shared pool
+    std::vector<MCSolver> ponderSolvers;
+    std::atomic<bool> ponderStopFlag = false;
+    std::vector<std::future<void>> ponderResults;
+
+    // the root of a search of the position, reused from the previous tree when possible
+    MCTNode& moveRoot(const Board& board, int selectedPiece);
+    // the node of the position below the root, NO_NODE if it was not expanded or the moves are unclear.
+    // the tree prunes symmetric moves, so the node may hold a symmetric position, returned in treeBoard and treeSelectedPiece
+    std::uint32_t findNode(const Board& board, int selectedPiece, Board& treeBoard, int& treeSelectedPiece) const;
+    // moves the subtree of node to the front of the arena, with every square and piece mapped to the position of the new root
+    void compactSubtree(std::uint32_t node, bool isSelectedNode,
+        const std::array<int, SQUARE_COUNT>& squareMap, const std::array<int, PIECE_COUNT>& pieceMap);
+
+public:
+    // caches : of the exact leaves, nullptr : a table of its own
+    explicit MCTSEngine(std::size_t arenaMemorySize = MCTS_ARENA_MEMORY_SIZE, std::shared_ptr<TranspositionTable> caches = nullptr);
+    ~MCTSEngine();
+    MCTSEngine(const MCTSEngine&) = delete;
+    MCTSEngine& operator=(const MCTSEngine&) = delete;
+    // for a new game
+    void clear();
+    // MCSolver::setRave for the following searches
+    void setRaveEquivalence(int raveEquivalence);
+    int selectPiece(const Board& board, PieceSet availablePieces, int moveTimeMs = 0);
+    std::array<int, 2> placePiece(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs = 0);
+    std::uint32_t getTreeSize() const;
+    // the expanded moves of the root of the last search, for the opening book
+    std::vector<MCTSMoveStatistics> getRootStatistics() const;
+
+    // pondering : searches the position the opponent moves from, selectedPiece -1 for a select, without waiting.
+    // the search goes on until stopPondering, and the next search starts from its tree when the game follows it
+    void startPondering(const Board& board, PieceSet availablePieces, int selectedPiece);
+    // returns once every thread of the pondering stopped. the other calls do it themselves
+    void stopPondering();
+};
+
+// graph parallel : the threads search one graph of canonical positions, 32 byte per node and 8 byte per edge
+constexpr std::size_t MCTS_GRAPH_MEMORY_SIZE = 1024 * 1024 * 1024;
+int selectPieceGraph(const Board& board, PieceSet availablePieces, int moveTimeMs = 0);
+std::array<int, 2> placePieceGraph(const Board& board, PieceSet availablePieces, int selectedPiece, int moveTimeMs = 0);
@@ -0,0 +1,232 @@
+#include "OpeningBook.h"
+#include "MonteCarlo.h"
+#include "negamax.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+namespace
+{
+    // same order as the MCTS picks a move of the root
+    double getEntryRank(const OpeningBook::Entry& entry)
+    {
+        constexpr double PROVEN_RANK = 1e12;
+        switch (entry.provenValue)
+        {
+        case WIN:
+            return PROVEN_RANK + entry.playoutCount;
+        case LOSS:
+            return entry.playoutCount / PROVEN_RANK;
+        default:
+            return entry.playoutCount;
+        }
+    }
+
+    bool isKeyLess(const OpeningBook::Entry& entry, long long key)
+    {
+        return entry.key < key;
+    }
+
+    struct BookPosition
+    {
+        Board board;
+        PieceSet availablePieces;
+        // -1 : the position to select
+        int selectedPiece;
+    };
+}
+
+bool OpeningBook::open(const std::string& path)
+{
+    entries = nullptr;
+    entryCount = 0;
+    if (!file.open(path) || file.getSize() < sizeof(Header))
+        return false;
+
+    Header header;
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION
+        || header.keyVersion != KEY_VERSION)
+        return false;
+    const std::size_t count = static_cast<std::size_t>(header.entryCount);
+    if (file.getSize() != sizeof(Header) + count * sizeof(Entry))
+        return false;
+
+    entries = reinterpret_cast<const Entry*>(file.getData() + sizeof(Header));
+    entryCount = count;
+    return true;
+}
+
+std::size_t OpeningBook::getEntryCount() const
+{
+    return entryCount;
+}
+
+bool OpeningBook::probe(const Board& board, int selectedPiece, int& move) const
+{
+    if (entryCount == 0)
+        return false;
+    SymmetryTransform transform;
+    const long long key = board.getNormalized(selectedPiece, transform);
+
+    const Entry* best = nullptr;
+    for (const Entry* entry = std::lower_bound(entries, entries + entryCount, key, isKeyLess);
+        entry != entries + entryCount && entry->key == key; entry++)
+    {
+        if (best == nullptr || getEntryRank(*entry) > getEntryRank(*best))
+            best = entry;
+    }
+    if (best == nullptr)
+        return false;
+
+    if (selectedPiece == -1)
+        move = transform.fromCanonicalPiece(best->move);
+    else
+        move = transform.fromCanonicalSquare(best->move);
+    return true;
+}
+
+bool OpeningBook::save(const std::string& path, std::vector<Entry> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry& left, const Entry& right)
+        {
+            return left.key != right.key ? left.key < right.key : left.move < right.move;
+        });
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.keyVersion = KEY_VERSION;
+    header.entryCount = entries.size();
+
+    // written aside and renamed, as a running engine may have the file at path mapped
+    const std::string writtenPath = path + ".tmp";
+    std::ofstream output{ writtenPath, std::ios_base::binary | std::ios_base::trunc };
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+    output.close();
+    if (!output)
+        return false;
+    return std::rename(writtenPath.c_str(), path.c_str()) == 0;
+}
+
+void OpeningBook::configureShared(const std::string& path)
+{
+    sharedPath = path;
+}
+
+const OpeningBook& OpeningBook::getShared()
+{
+    static OpeningBook sharedBook;
+    static const bool isOpened = !sharedPath.empty() && sharedBook.open(sharedPath);
+    (void)isOpened;
+    return sharedBook;
+}
+
+bool buildOpeningBook(int plyCount, int moveTimeMs, const std::string& path)
+{
+    // one canonical position per key, ply by ply, with symmetric moves pruned
+    std::vector<BookPosition> positions{ { Board(), PieceSet::all(), -1 } };
+    std::vector<OpeningBook::Entry> entries;
+    auto caches = std::make_shared<TranspositionTable>(Solver::CACHE_MEMORY_SIZE);
+    MCTSEngine engine(MCTS_ARENA_MEMORY_SIZE, caches);
+    for (int ply = 0; ply < plyCount && !positions.empty(); ply++)
+    {
+        std::cerr << "book ply " << ply << " positions : " << positions.size() << '\n';
+        std::vector<BookPosition> nextPositions;
+        std::unordered_set<long long> nextKeys;
+        for (const BookPosition& position : positions)
+        {
+            const Board& board = position.board;
+            SymmetryTransform transform;
+            const long long key = board.getNormalized(position.selectedPiece, transform);
+
+            if (ply >= NEGAMAX_START_DEPTH)
+            {
+                // the negamax answers these plies exactly, so the book keeps its move and value
+                PieceSet availablePieces = position.availablePieces;
+                int move;
+                Utility value;
+                if (position.selectedPiece == -1)
+                {
+                    Solver solver(board, availablePieces, caches);
+                    solver.setVerbose(false);
+                    value = solver.solveSelect(move);
+                    move = transform.toCanonicalPiece(move);
+                }
+                else
+                {
+                    availablePieces.insert(position.selectedPiece);
+                    Solver solver(board, availablePieces, caches);
+                    solver.setVerbose(false);
+                    std::pair<int, int> place;
+                    value = solver.solvePlace(position.selectedPiece, place);
+                    move = transform.toCanonicalSquare(place.first * BOARD_COLS + place.second);
+                }
+                OpeningBook::Entry entry{};
+                entry.key = key;
+                entry.move = static_cast<std::int8_t>(move);
+                entry.provenValue = static_cast<std::int8_t>(value);
+                entries.push_back(entry);
+            }
+            else
+            {
+                // each position on a tree of its own, so the statistics do not depend on the order of the positions
+                engine.clear();
+                if (position.selectedPiece == -1)
+                    engine.selectPiece(board, position.availablePieces, moveTimeMs);
+                else
+                    engine.placePiece(board, position.availablePieces, position.selectedPiece, moveTimeMs);
+                for (const MCTSMoveStatistics& statistics : engine.getRootStatistics())
+                {
+                    if (statistics.playoutCount == 0)
+                        continue;
+                    OpeningBook::Entry entry{};
+                    entry.key = key;
+                    entry.playoutCount = statistics.playoutCount;
+                    entry.score = statistics.score;
+                    entry.move = static_cast<std::int8_t>(position.selectedPiece == -1
+                        ? transform.toCanonicalPiece(statistics.move) : transform.toCanonicalSquare(statistics.move));
+                    entry.provenValue = statistics.provenValue;
+                    entries.push_back(entry);
+                }
+            }
+
+            if (ply + 1 == plyCount)
+                continue;
+            if (position.selectedPiece == -1)
+            {
+                for (int piece : PieceSet(board.getDistinctPieces(position.availablePieces.getMask())))
+                {
+                    BookPosition next{ board, position.availablePieces, piece };
+                    next.availablePieces.erase(piece);
+                    if (nextKeys.insert(board.getNormalized(piece)).second)
+                        nextPositions.push_back(next);
+                }
+            }
+            else
+            {
+                const SquareMask places = board.getDistinctPlaces(position.selectedPiece);
+                for (int square = 0; square < SQUARE_COUNT; square++)
+                {
+                    if (!((places >> square) & 1))
+                        continue;
+                    BookPosition next{ board, position.availablePieces, -1 };
+                    next.board.set(square / BOARD_COLS, square % BOARD_COLS, position.selectedPiece);
+                    if (next.board.isWinnerExist() || next.availablePieces.empty())
+                        continue;
+                    if (nextKeys.insert(next.board.getNormalized(-1)).second)
+                        nextPositions.push_back(next);
+                }
+            }
+        }
+        positions.swap(nextPositions);
+    }
+
+    std::cerr << "book entries : " << entries.size() << '\n';
+    return OpeningBook::save(path, std::move(entries));
+}
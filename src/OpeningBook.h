@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Board.h"
+#include "MappedFile.h"
+
+// moves of the early positions, searched offline by buildOpeningBook.
+// keyed by Board::getNormalized(selectedPiece), with the moves in the canonical form.
+// file : Header, then the entries sorted by key and move. mapped read-only
+class OpeningBook
+{
+public:
+    struct Entry
+    {
+        long long key;
+        std::int32_t playoutCount;
+        std::int32_t score;
+        // piece or square in the canonical form
+        std::int8_t move;
+        // MCTNode::NOT_PROVEN, or the exact value for the player making the move
+        std::int8_t provenValue;
+        std::uint8_t padding[6];
+    };
+
+private:
+    struct Header
+    {
+        char magic[4];
+        std::uint32_t version;
+        // keys and canonical moves of another version mean other positions
+        std::uint32_t keyVersion;
+        std::uint32_t reserved;
+        std::uint64_t entryCount;
+    };
+    static constexpr char MAGIC[4] = { 'Q', 'O', 'B', '1' };
+    static constexpr std::uint32_t FORMAT_VERSION = 2;
+    // bump when Board::getNormalized or the canonical moves of SymmetryTransform change
+    static constexpr std::uint32_t KEY_VERSION = 1;
+
+    MappedFile file;
+    const Entry* entries = nullptr;
+    std::size_t entryCount = 0;
+
+    static inline std::string sharedPath;
+
+public:
+    // false : missing, not a book file or of another key version, and the book stays empty
+    bool open(const std::string& path);
+    std::size_t getEntryCount() const;
+    // the move of the position, piece to select (selectedPiece -1) or square to place on.
+    // the most played move, but a proven win goes first and a proven loss last. false : out of book
+    bool probe(const Board& board, int selectedPiece, int& move) const;
+
+    static bool save(const std::string& path, std::vector<Entry> entries);
+
+    // the book of the process, empty without a path. configure before the first getShared
+    static void configureShared(const std::string& path);
+    static const OpeningBook& getShared();
+};
+
+// searches every canonical position of the first plyCount plies (ply : filled squares * 2, + 1 to place)
+// and saves their moves to path. the plies before NEGAMAX_START_DEPTH are searched with MCTS for moveTimeMs each
+// and keep the statistics of every move, the later ones are solved by the negamax and keep the best move with its value
+bool buildOpeningBook(int plyCount, int moveTimeMs, const std::string& path);
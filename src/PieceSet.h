@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include "Board.h"
+
+// set of pieces, bit index = piece
+class PieceSet
+{
+private:
+    std::uint16_t pieces = 0;
+
+public:
+    // visits pieces in increasing order
+    class Iterator
+    {
+    private:
+        std::uint16_t rest;
+
+    public:
+        constexpr explicit Iterator(std::uint16_t rest) :rest(rest) {}
+        constexpr int operator*() const { return countBits(static_cast<std::uint32_t>((rest & -rest) - 1)); }
+        constexpr Iterator& operator++() { rest &= rest - 1; return *this; }
+        constexpr bool operator!=(const Iterator& other) const { return rest != other.rest; }
+    };
+
+    constexpr PieceSet() = default;
+    constexpr explicit PieceSet(std::uint16_t pieces) :pieces(pieces) {}
+    static constexpr PieceSet all() { return PieceSet(static_cast<std::uint16_t>((1u << PIECE_COUNT) - 1)); }
+
+    constexpr bool contains(int piece) const { return (pieces >> piece) & 1; }
+    constexpr void insert(int piece) { pieces |= static_cast<std::uint16_t>(1u << piece); }
+    constexpr void erase(int piece) { pieces &= static_cast<std::uint16_t>(~(1u << piece)); }
+    constexpr void clear() { pieces = 0; }
+    constexpr bool empty() const { return pieces == 0; }
+    constexpr int size() const { return countBits(pieces); }
+    constexpr std::uint16_t getMask() const { return pieces; }
+
+    constexpr Iterator begin() const { return Iterator(pieces); }
+    constexpr Iterator end() const { return Iterator(0); }
+
+    // index-th piece in increasing order, index < size()
+    constexpr int getNth(int index) const
+    {
+        std::uint16_t rest = pieces;
+        for (int i = 0; i < index; i++)
+            rest &= rest - 1;
+        return *Iterator(rest);
+    }
+
+    // must not be empty
+    template <typename RandomEngine>
+    int pickRandom(RandomEngine& randomEngine) const
+    {
+        std::uniform_int_distribution<int> distribution(0, size() - 1);
+        return getNth(distribution(randomEngine));
+    }
+};
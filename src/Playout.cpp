@@ -0,0 +1,138 @@
+#include "Playout.h"
+
+namespace
+{
+    // TERMINATOR_PIECES[values] : pieces having one of the trait values, bit trait * 2 + value
+    constexpr std::array<std::uint16_t, 1 << (TRAIT_COUNT * 2)> makeTerminatorPieces()
+    {
+        std::array<std::uint16_t, 1 << (TRAIT_COUNT * 2)> result{};
+        for (int values = 0; values < (1 << (TRAIT_COUNT * 2)); values++)
+        {
+            for (int piece = 0; piece < PIECE_COUNT; piece++)
+            {
+                for (int trait = 0; trait < TRAIT_COUNT; trait++)
+                {
+                    if (values & (1 << (trait * 2 + ((piece >> trait) & 1))))
+                        result[values] |= static_cast<std::uint16_t>(1u << piece);
+                }
+            }
+        }
+        return result;
+    }
+
+    constexpr std::array<std::uint16_t, 1 << (TRAIT_COUNT * 2)> TERMINATOR_PIECES = makeTerminatorPieces();
+
+    constexpr SquareMask FULL_BOARD = static_cast<SquareMask>((1u << SQUARE_COUNT) - 1);
+}
+
+Playout::Playout(const Board& board, PieceSet availablePieces)
+    :occupied(board.getOccupied()), availablePieces(availablePieces), isWinnerExist(board.isWinnerExist())
+{
+    for (int trait = 0; trait < TRAIT_COUNT; trait++)
+    {
+        traitPlanes[trait] = board.getTraitPlane(trait);
+        for (int value = 0; value < 2; value++)
+            terminatorGroupCounts[trait * 2 + value] = static_cast<std::uint8_t>(board.getTerminatorGroupCount(trait, value));
+    }
+}
+
+PieceSet Playout::getTerminatorPieces() const
+{
+    int values = 0;
+    for (int i = 0; i < TRAIT_COUNT * 2; i++)
+    {
+        if (terminatorGroupCounts[i] > 0)
+            values |= 1 << i;
+    }
+    return PieceSet(TERMINATOR_PIECES[values]);
+}
+
+bool Playout::isWinningPlace(int square, int piece) const
+{
+    const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+    for (int i = 0; i < squareGroups.count; i++)
+    {
+        const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+        const SquareMask filled = occupied & group;
+        if (countBits(filled) != 3)
+            continue;
+        for (int trait = 0; trait < TRAIT_COUNT; trait++)
+        {
+            const SquareMask ones = traitPlanes[trait] & group;
+            if ((piece >> trait) & 1 ? ones == filled : ones == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+void Playout::place(int square, int piece)
+{
+    const SquareGroups& squareGroups = SQUARE_GROUPS[square];
+    const SquareMask bit = static_cast<SquareMask>(1u << square);
+    // sign -1 : groups losing their empty square, +1 : groups reaching 3 pieces
+    for (int sign = -1; sign <= 1; sign += 2)
+    {
+        if (sign == 1)
+        {
+            occupied |= bit;
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                if ((piece >> trait) & 1)
+                    traitPlanes[trait] |= bit;
+            }
+        }
+
+        for (int i = 0; i < squareGroups.count; i++)
+        {
+            const SquareMask group = WINNING_GROUPS[squareGroups.groups[i]];
+            const SquareMask filled = occupied & group;
+            if (countBits(filled) != 3)
+                continue;
+            for (int trait = 0; trait < TRAIT_COUNT; trait++)
+            {
+                const SquareMask ones = traitPlanes[trait] & group;
+                if (ones == filled)
+                    terminatorGroupCounts[trait * 2 + 1] += sign;
+                else if (ones == 0)
+                    terminatorGroupCounts[trait * 2] += sign;
+            }
+        }
+    }
+}
+
+int Playout::playSelect(PlayoutRandom& random)
+{
+    if (isWinnerExist)
+        return 1;
+
+    // result for the player who placed last, the players alternate every loop
+    int sign = 1;
+    while (occupied != FULL_BOARD)
+    {
+        const std::uint16_t safePieces = availablePieces.getMask() & ~getTerminatorPieces().getMask();
+        if (safePieces == 0)
+            return -sign;
+
+        const int piece = random.pickBit(safePieces);
+        const int filledCount = countBits(occupied);
+        availablePieces.erase(piece);
+        moves.addSelect(filledCount, piece);
+        // the piece completes no group, so the next player only fills a square
+        const int square = random.pickBit(static_cast<std::uint16_t>(~occupied));
+        moves.addPlace(filledCount, square);
+        place(square, piece);
+        sign = -sign;
+    }
+    return 0;
+}
+
+int Playout::playPlace(int selectedPiece, PlayoutRandom& random)
+{
+    const int square = random.pickBit(static_cast<std::uint16_t>(~occupied));
+    moves.addPlace(countBits(occupied), square);
+    if (isWinningPlace(square, selectedPiece))
+        return 1;
+    place(square, selectedPiece);
+    return playSelect(random);
+}
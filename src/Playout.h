@@ -0,0 +1,77 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "Board.h"
+#include "PieceSet.h"
+
+// xorshift64*, a few operations per number. playouts need speed, not quality
+class PlayoutRandom
+{
+private:
+    std::uint64_t state;
+
+public:
+    explicit PlayoutRandom(std::uint64_t seed) :state(seed != 0 ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+    std::uint32_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<std::uint32_t>((state * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+
+    // uniform bit index of a non-empty mask
+    int pickBit(std::uint16_t mask)
+    {
+        int index = static_cast<int>((std::uint64_t{ next() } * countBits(mask)) >> 32);
+        for (; index > 0; index--)
+            mask &= mask - 1;
+        return countBits(static_cast<std::uint32_t>((mask & -mask) - 1));
+    }
+};
+
+// the moves of one iteration below a node, for AMAF. a square is filled and a piece is selected once a game,
+// so masks are enough. [player] : the filled count modulo 2 when the player places
+struct AmafMoves
+{
+    std::array<std::uint16_t, 2> placedSquares{};
+    std::array<std::uint16_t, 2> selectedPieces{};
+
+    void addPlace(int filledCount, int square) { placedSquares[filledCount % 2] |= static_cast<std::uint16_t>(1u << square); }
+    // selected by the player who placed the last of filledCount pieces
+    void addSelect(int filledCount, int piece) { selectedPieces[(filledCount + 1) % 2] |= static_cast<std::uint16_t>(1u << piece); }
+    // the moves of the player placing on a board of filledCount pieces, or selecting after it
+    std::uint16_t getPlacedSquares(int filledCount) const { return placedSquares[filledCount % 2]; }
+    std::uint16_t getSelectedPieces(int filledCount) const { return selectedPieces[(filledCount + 1) % 2]; }
+};
+
+// random playout on a copy of the position : bit planes only, no heap allocation and no undo.
+// nobody selects a piece that completes a group while another piece is left, so after the first move
+// a game only ends when the board is full or when every piece left is a terminator
+class Playout
+{
+private:
+    SquareMask occupied = 0;
+    std::array<SquareMask, TRAIT_COUNT> traitPlanes{};
+    // terminatorGroupCounts[trait * 2 + value] : groups of 3 pieces sharing the value at the trait
+    std::array<std::uint8_t, TRAIT_COUNT * 2> terminatorGroupCounts{};
+    PieceSet availablePieces;
+    bool isWinnerExist = false;
+    AmafMoves moves;
+
+    // pieces that complete a group somewhere on the board
+    PieceSet getTerminatorPieces() const;
+    bool isWinningPlace(int square, int piece) const;
+    void place(int square, int piece);
+
+public:
+    Playout(const Board& board, PieceSet availablePieces);
+
+    // same results as MCSolver::playoutSelect and playoutPlace :
+    // 1 win, 0 draw, -1 loss for the player who placed last, or for the player who places selectedPiece
+    int playSelect(PlayoutRandom& random);
+    int playPlace(int selectedPiece, PlayoutRandom& random);
+    // the moves played, until the game was decided
+    const AmafMoves& getMoves() const { return moves; }
+};
@@ -0,0 +1,232 @@
+#include "Tablebase.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <unordered_map>
+
+namespace
+{
+    // 2 bit per value : LOSS 0, DRAW 1, WIN 2
+    std::uint8_t packValue(Utility value)
+    {
+        return static_cast<std::uint8_t>(value + 1);
+    }
+
+    Utility unpackValue(std::uint8_t packed)
+    {
+        return static_cast<Utility>(static_cast<int>(packed) - 1);
+    }
+
+    // full minimax without pruning, so every reachable position gets its value.
+    // positions with at most maxEmptyCount empty squares are memoized by canonical key
+    class TablebaseBuilder
+    {
+    private:
+        Board board;
+        PieceSet availablePieces;
+        int maxEmptyCount;
+        std::unordered_map<long long, Utility>& values;
+
+    public:
+        TablebaseBuilder(const Board& board, PieceSet availablePieces, int maxEmptyCount, std::unordered_map<long long, Utility>& values)
+            :board(board), availablePieces(availablePieces), maxEmptyCount(maxEmptyCount), values(values)
+        {
+        }
+
+        // for the player to select
+        Utility solveSelect()
+        {
+            if (board.isWinnerExist())
+                return WIN;
+            if (availablePieces.empty())
+                return DRAW;
+
+            const bool isStored = SQUARE_COUNT - board.getFilledCount() <= maxEmptyCount;
+            long long key = 0;
+            if (isStored)
+            {
+                key = board.getNormalized(-1);
+                auto found = values.find(key);
+                if (found != values.end())
+                    return found->second;
+            }
+
+            Utility best = UTILITY_MIN;
+            const PieceSet pieces = availablePieces;
+            for (int piece : pieces)
+                best = std::max(best, static_cast<Utility>(-solvePlace(piece)));
+
+            if (isStored)
+                values.emplace(key, best);
+            return best;
+        }
+
+        // for the player to place
+        Utility solvePlace(int selectedPiece)
+        {
+            availablePieces.erase(selectedPiece);
+            Utility best = UTILITY_MIN;
+            for (int square = 0; square < SQUARE_COUNT; square++)
+            {
+                const int row = square / BOARD_COLS;
+                const int col = square % BOARD_COLS;
+                if (board.get(row, col) != -1)
+                    continue;
+                board.set(row, col, selectedPiece);
+                best = std::max(best, solveSelect());
+                board.set(row, col, -1);
+            }
+            availablePieces.insert(selectedPiece);
+            return best;
+        }
+    };
+}
+
+bool Tablebase::open(const std::string& path)
+{
+    keys = nullptr;
+    values = nullptr;
+    entryCount = 0;
+    maxEmptyCount = -1;
+    if (!file.open(path) || file.getSize() < sizeof(Header))
+        return false;
+
+    Header header;
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION
+        || header.keyVersion != KEY_VERSION)
+        return false;
+    const std::size_t count = static_cast<std::size_t>(header.entryCount);
+    if (file.getSize() != sizeof(Header) + count * sizeof(long long) + (count + 3) / 4)
+        return false;
+
+    keys = reinterpret_cast<const long long*>(file.getData() + sizeof(Header));
+    values = reinterpret_cast<const std::uint8_t*>(keys + count);
+    entryCount = count;
+    maxEmptyCount = static_cast<int>(header.maxEmptyCount);
+    return true;
+}
+
+int Tablebase::getMaxEmptyCount() const
+{
+    return maxEmptyCount;
+}
+
+std::size_t Tablebase::getEntryCount() const
+{
+    return entryCount;
+}
+
+bool Tablebase::probe(long long key, Utility& value) const
+{
+    const long long* found = std::lower_bound(keys, keys + entryCount, key);
+    if (found == keys + entryCount || *found != key)
+        return false;
+    const std::size_t index = static_cast<std::size_t>(found - keys);
+    value = unpackValue((values[index / 4] >> (index % 4 * 2)) & 0x3);
+    return true;
+}
+
+bool Tablebase::save(const std::string& path, int maxEmptyCount, std::vector<std::pair<long long, Utility>> entries)
+{
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end(),
+        [](const auto& left, const auto& right) { return left.first == right.first; }), entries.end());
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.maxEmptyCount = static_cast<std::uint32_t>(maxEmptyCount);
+    header.keyVersion = KEY_VERSION;
+    header.entryCount = entries.size();
+
+    std::vector<long long> sortedKeys(entries.size());
+    std::vector<std::uint8_t> packedValues((entries.size() + 3) / 4);
+    for (std::size_t i = 0; i < entries.size(); i++)
+    {
+        sortedKeys[i] = entries[i].first;
+        packedValues[i / 4] |= static_cast<std::uint8_t>(packValue(entries[i].second) << (i % 4 * 2));
+    }
+
+    // written aside and renamed, as a running engine may have the file at path mapped
+    const std::string writtenPath = path + ".tmp";
+    std::ofstream output{ writtenPath, std::ios_base::binary | std::ios_base::trunc };
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(sortedKeys.data()), sortedKeys.size() * sizeof(long long));
+    output.write(reinterpret_cast<const char*>(packedValues.data()), packedValues.size());
+    output.close();
+    if (!output)
+        return false;
+    return std::rename(writtenPath.c_str(), path.c_str()) == 0;
+}
+
+void Tablebase::configureShared(const std::string& path)
+{
+    sharedPath = path;
+}
+
+const Tablebase& Tablebase::getShared()
+{
+    static Tablebase sharedTablebase;
+    static const bool isOpened = !sharedPath.empty() && sharedTablebase.open(sharedPath);
+    (void)isOpened;
+    return sharedTablebase;
+}
+
+bool buildTablebase(const std::vector<TablebaseSeed>& seeds, int maxEmptyCount, const std::string& path)
+{
+    // a task per move of each seed. positions reachable by several moves are solved by each task
+    struct Task
+    {
+        const TablebaseSeed* seed;
+        int selectedPiece;
+        std::unordered_map<long long, Utility> values;
+    };
+    std::vector<Task> tasks;
+    for (const TablebaseSeed& seed : seeds)
+    {
+        if (seed.board.isWinnerExist())
+            continue;
+        if (seed.selectedPiece != -1)
+        {
+            tasks.push_back({ &seed, seed.selectedPiece, {} });
+            continue;
+        }
+        for (int piece : seed.availablePieces)
+            tasks.push_back({ &seed, piece, {} });
+    }
+
+    std::vector<std::future<void>> results;
+    results.reserve(tasks.size());
+    for (Task& task : tasks)
+    {
+        results.push_back(ThreadPool::getShared().submit([&task, maxEmptyCount]
+            {
+                TablebaseBuilder builder(task.seed->board, task.seed->availablePieces, maxEmptyCount, task.values);
+                builder.solvePlace(task.selectedPiece);
+            }));
+    }
+    for (auto& result : results)
+        result.get();
+
+    std::unordered_map<long long, Utility> values;
+    for (Task& task : tasks)
+    {
+        values.insert(task.values.begin(), task.values.end());
+        task.values = {};
+    }
+    // the seeds themselves, from the values of their children
+    for (const TablebaseSeed& seed : seeds)
+    {
+        if (seed.selectedPiece == -1)
+            TablebaseBuilder(seed.board, seed.availablePieces, maxEmptyCount, values).solveSelect();
+    }
+
+    std::cerr << "tablebase positions : " << values.size() << '\n';
+    return Tablebase::save(path, maxEmptyCount, std::vector<std::pair<long long, Utility>>(values.begin(), values.end()));
+}
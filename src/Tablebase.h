@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Board.h"
+#include "MappedFile.h"
+#include "PieceSet.h"
+#include "TranspositionTable.h"
+
+// exact values of endgame positions, built offline by buildTablebase.
+// keyed by Board::getNormalized(-1) : the value is for the player to select, the pieces not on the board available.
+// file : Header, the keys sorted, then the values, 2 bit each and 4 per byte. mapped read-only
+class Tablebase
+{
+private:
+    struct Header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t maxEmptyCount;
+        // keys of another version mean other positions
+        std::uint32_t keyVersion;
+        std::uint64_t entryCount;
+    };
+    static constexpr char MAGIC[4] = { 'Q', 'T', 'B', '1' };
+    static constexpr std::uint32_t FORMAT_VERSION = 1;
+    // bump when Board::getNormalized changes
+    static constexpr std::uint32_t KEY_VERSION = 1;
+
+    MappedFile file;
+    const long long* keys = nullptr;
+    const std::uint8_t* values = nullptr;
+    std::size_t entryCount = 0;
+    // -1 : no table, nothing to probe
+    int maxEmptyCount = -1;
+
+    static inline std::string sharedPath;
+
+public:
+    // false : missing, not a tablebase file or of another key version, and the table stays empty
+    bool open(const std::string& path);
+    int getMaxEmptyCount() const;
+    std::size_t getEntryCount() const;
+    // binary search in the keys
+    bool probe(long long key, Utility& value) const;
+
+    // entries : (key, exact value), in any order
+    static bool save(const std::string& path, int maxEmptyCount, std::vector<std::pair<long long, Utility>> entries);
+
+    // the table of the negamax of the process, empty without a path. configure before the first getShared
+    static void configureShared(const std::string& path);
+    static const Tablebase& getShared();
+};
+
+struct TablebaseSeed
+{
+    Board board;
+    PieceSet availablePieces;
+    // -1 : the position to select
+    int selectedPiece = -1;
+};
+
+// solves every position with at most maxEmptyCount empty squares reachable from the seeds by full minimax
+// over canonical keys, on the shared pool, and saves them to path. the positions reachable from a seed grow
+// with the factorial of its empty squares, so seeds should have only a few more than maxEmptyCount
+bool buildTablebase(const std::vector<TablebaseSeed>& seeds, int maxEmptyCount, const std::string& path);
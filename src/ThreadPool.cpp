@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+namespace
+{
+    // the CPUs the process may run on (taskset, cgroups), which need not be 0 to hardware_concurrency - 1
+    std::vector<int> getAllowedCpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuSet) != 0)
+            return cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &cpuSet))
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+}
+#endif
+
+ThreadPool::ThreadPool(int threadCount, bool isPinned)
+{
+    const int coreCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (threadCount <= 0)
+        threadCount = coreCount;
+#ifdef __linux__
+    const std::vector<int> pinnedCpus = isPinned ? getAllowedCpus() : std::vector<int>();
+#endif
+
+    workers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([this] { runWorker(); });
+#ifdef __linux__
+        if (!pinnedCpus.empty())
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(pinnedCpus[i % pinnedCpus.size()], &cpuSet);
+            pthread_setaffinity_np(workers.back().native_handle(), sizeof(cpu_set_t), &cpuSet);
+        }
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    taskAdded.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+int ThreadPool::getThreadCount() const
+{
+    return static_cast<int>(workers.size());
+}
+
+void ThreadPool::runWorker()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAdded.wait(lock, [this] { return isStopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::configureShared(int threadCount, bool isPinned)
+{
+    sharedThreadCount = threadCount;
+    isSharedPinned = isPinned;
+}
+
+ThreadPool& ThreadPool::getShared()
+{
+    static ThreadPool sharedPool(sharedThreadCount, isSharedPinned);
+    return sharedPool;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// workers started once and reused by every search, instead of threads started for each move.
+// a task runs on one worker. tasks waiting on other tasks of the pool would deadlock, so the
+// thread that submits the tasks of a search waits for them itself
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAdded;
+    bool isStopping = false;
+
+    void runWorker();
+
+    // the size of the shared pool, read at its start
+    static inline int sharedThreadCount = 0;
+    static inline bool isSharedPinned = false;
+
+public:
+    // threadCount 0 : one per hardware thread. isPinned : worker i only runs on the i-th CPU the process is allowed on, on Linux
+    explicit ThreadPool(int threadCount = 0, bool isPinned = false);
+    // waits for the tasks already submitted
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int getThreadCount() const;
+
+    template <typename Task>
+    std::future<std::invoke_result_t<Task>> submit(Task task)
+    {
+        auto packagedTask = std::make_shared<std::packaged_task<std::invoke_result_t<Task>()>>(std::move(task));
+        std::future<std::invoke_result_t<Task>> result = packagedTask->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+        }
+        taskAdded.notify_one();
+        return result;
+    }
+
+    // the pool of the searches of the process, MCTS and negamax. configure before the first getShared
+    static void configureShared(int threadCount, bool isPinned);
+    static ThreadPool& getShared();
+};
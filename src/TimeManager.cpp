@@ -0,0 +1,91 @@
+#include "TimeManager.h"
+
+#include <algorithm>
+#include "Board.h"
+#include "negamax.h"
+
+TimeManager::TimeManager(int moveTimeMs)
+    :startTime(std::chrono::steady_clock::now()), targetMs(moveTimeMs / 2), maximumMs(moveTimeMs)
+{
+}
+
+int TimeManager::getMoveTimeFromClock(int remainingClockMs, int ply)
+{
+    if (ply >= NEGAMAX_START_DEPTH)
+        return remainingClockMs / 2;
+
+    // a side plays a place and the next select, so the plies of this side are those with the same (ply + 1) / 2 parity
+    int shareCount = 1;
+    for (int otherPly = ply; otherPly < NEGAMAX_START_DEPTH; otherPly++)
+    {
+        if ((otherPly + 1) / 2 % 2 == (ply + 1) / 2 % 2)
+            shareCount++;
+    }
+    return remainingClockMs / shareCount;
+}
+
+int TimeManager::getElapsedMs() const
+{
+    using namespace std::chrono;
+    return static_cast<int>(duration_cast<milliseconds>(steady_clock::now() - startTime).count());
+}
+
+bool TimeManager::shouldStop(const SearchProgress& progress)
+{
+    if (progress.isSolved)
+        return true;
+
+    const int elapsedMs = getElapsedMs();
+    if (progress.bestMove != lastBestMove)
+    {
+        lastBestMove = progress.bestMove;
+        lastBestMoveChangeMs = elapsedMs;
+    }
+    if (elapsedMs > lastCheckMs)
+    {
+        iterationsPerMs = static_cast<double>(progress.iterationCount - lastIterationCount) / (elapsedMs - lastCheckMs);
+        lastCheckMs = elapsedMs;
+        lastIterationCount = progress.iterationCount;
+    }
+
+    // the best move changed during the last quarter of the search, so it gets the extra time
+    const bool isUnstable = (elapsedMs - lastBestMoveChangeMs) * 4 < elapsedMs;
+    const int limitMs = isUnstable ? maximumMs : targetMs;
+    if (elapsedMs >= limitMs)
+        return true;
+    if (elapsedMs < MINIMUM_SEARCH_MS)
+        return false;
+
+    // even if every iteration left went to the second best move, it would stay behind
+    return progress.bestPlayoutCount - progress.secondPlayoutCount > iterationsPerMs * (limitMs - elapsedMs);
+}
+
+StopTimer::StopTimer(int timeMs)
+{
+    thread = std::thread([this, timeMs]
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!ended.wait_for(lock, std::chrono::milliseconds(timeMs), [this] { return isEnded; }))
+                isTimeUp = true;
+        });
+}
+
+StopTimer::~StopTimer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isEnded = true;
+    }
+    ended.notify_one();
+    thread.join();
+}
+
+const std::atomic<bool>* StopTimer::getFlag() const
+{
+    return &isTimeUp;
+}
+
+bool StopTimer::isExpired() const
+{
+    return isTimeUp;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// what the time manager reads from the root of a search
+struct SearchProgress
+{
+    // the move the search would play now, -1 if unknown
+    int bestMove = -1;
+    int bestPlayoutCount = 0;
+    int secondPlayoutCount = 0;
+    long long iterationCount = 0;
+    bool isSolved = false;
+};
+
+// decides when an MCTS search stops. a stable search stops at the target time. a search whose
+// best move changed recently may go on to the maximum time. both stop earlier once the best move
+// can no longer be overtaken
+class TimeManager
+{
+private:
+    std::chrono::steady_clock::time_point startTime;
+    int targetMs;
+    int maximumMs;
+
+    int lastBestMove = -1;
+    int lastBestMoveChangeMs = 0;
+    int lastCheckMs = 0;
+    long long lastIterationCount = 0;
+    double iterationsPerMs = 0;
+
+public:
+    // without a clock
+    static constexpr int DEFAULT_MOVE_TIME_MS = 1000 * 5;
+    static constexpr int DEFAULT_IMPORTANT_MOVE_TIME_MS = 1000 * 20;
+    // how often shouldStop is called while the threads search
+    static constexpr int CHECK_INTERVAL_MS = 10;
+    // the iteration rate and the visit counts mean little before this
+    static constexpr int MINIMUM_SEARCH_MS = 100;
+
+    // moveTimeMs : the most this move may take
+    explicit TimeManager(int moveTimeMs);
+    // a share of the time left for the game. ply : filled squares * 2, + 1 to place.
+    // before NEGAMAX_START_DEPTH, the clock is split over the MCTS moves left of this side and one share for the
+    // whole negamax phase. in the negamax phase, the first moves are the slow ones, so a move gets half of the clock
+    static int getMoveTimeFromClock(int remainingClockMs, int ply);
+
+    int getElapsedMs() const;
+    bool shouldStop(const SearchProgress& progress);
+};
+
+// sets a flag once the time passed, for searches that check a flag but not the clock, like the negamax
+class StopTimer
+{
+private:
+    std::atomic<bool> isTimeUp = false;
+    std::mutex mutex;
+    std::condition_variable ended;
+    bool isEnded = false;
+    std::thread thread;
+
+public:
+    explicit StopTimer(int timeMs);
+    // ends the timer without setting the flag if the time has not passed
+    ~StopTimer();
+    StopTimer(const StopTimer&) = delete;
+    StopTimer& operator=(const StopTimer&) = delete;
+
+    const std::atomic<bool>* getFlag() const;
+    bool isExpired() const;
+};
@@ -0,0 +1,500 @@
+#include "TranspositionTable.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <queue>
+#include <tuple>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::uint64_t mixKey(std::uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return key;
+}
+
+TranspositionTable::TranspositionTable(std::size_t memorySize)
+{
+    std::size_t bucketCount = 1;
+    while (bucketCount * 2 * sizeof(Bucket) <= memorySize)
+        bucketCount *= 2;
+    bucketMask = bucketCount - 1;
+
+    // zero pages are handed out lazily by the OS, so an unused budget costs nothing
+    allocatedSize = bucketCount * sizeof(Bucket);
+#ifdef __linux__
+    allocated = mmap(nullptr, allocatedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (allocated == MAP_FAILED)
+        throw std::bad_alloc();
+    // random probes over a large table are dominated by page faults and TLB misses without huge pages
+    madvise(allocated, allocatedSize, MADV_HUGEPAGE);
+    buckets = static_cast<Bucket*>(allocated);
+#else
+    // one extra bucket for the alignment
+    allocated = std::calloc(bucketCount + 1, sizeof(Bucket));
+    if (allocated == nullptr)
+        throw std::bad_alloc();
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(allocated);
+    address = (address + alignof(Bucket) - 1) & ~static_cast<std::uintptr_t>(alignof(Bucket) - 1);
+    buckets = reinterpret_cast<Bucket*>(address);
+#endif
+}
+
+TranspositionTable::~TranspositionTable()
+{
+#ifdef __linux__
+    munmap(allocated, allocatedSize);
+#else
+    std::free(allocated);
+#endif
+}
+
+std::uint64_t TranspositionTable::packData(const CacheValue& value, int draft, std::uint8_t age)
+{
+    // bounds are stored +2 so that upperBound is never 0 and data of a used entry is never 0
+    return static_cast<std::uint64_t>(value.lowerBound - UTILITY_MIN)
+        | static_cast<std::uint64_t>(value.upperBound - UTILITY_MIN) << 4
+        | static_cast<std::uint64_t>(draft) << 8
+        | static_cast<std::uint64_t>(age) << 16
+        | static_cast<std::uint64_t>(value.bestMove + 1) << 24;
+}
+
+CacheValue TranspositionTable::unpackValue(std::uint64_t data)
+{
+    return { static_cast<Utility>(static_cast<int>(data & 0xF) + UTILITY_MIN),
+        static_cast<Utility>(static_cast<int>((data >> 4) & 0xF) + UTILITY_MIN),
+        static_cast<signed char>(static_cast<int>((data >> 24) & 0xFF) - 1) };
+}
+
+int TranspositionTable::unpackDraft(std::uint64_t data)
+{
+    return static_cast<int>((data >> 8) & 0xFF);
+}
+
+std::uint8_t TranspositionTable::unpackAge(std::uint64_t data)
+{
+    return static_cast<std::uint8_t>((data >> 16) & 0xFF);
+}
+
+TranspositionTable::Bucket& TranspositionTable::getBucket(long long key) const
+{
+    return buckets[mixKey(static_cast<std::uint64_t>(key)) & bucketMask];
+}
+
+bool TranspositionTable::probe(long long key, CacheValue& value) const
+{
+    for (const Entry& entry : getBucket(key).entries)
+    {
+        const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+        const std::uint64_t entryKey = entry.keyXorData.load(std::memory_order_relaxed) ^ data;
+        if (data != 0 && entryKey == static_cast<std::uint64_t>(key))
+        {
+            value = unpackValue(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(long long key, const CacheValue& value, int draft)
+{
+    Bucket& bucket = getBucket(key);
+
+    // same key, or the least valuable entry : empty first, then older searches, then smaller draft
+    Entry* replaced = nullptr;
+    int replacedScore = 0;
+    for (Entry& entry : bucket.entries)
+    {
+        const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+        const std::uint64_t entryKey = entry.keyXorData.load(std::memory_order_relaxed) ^ data;
+        if (data != 0 && entryKey == static_cast<std::uint64_t>(key))
+        {
+            replaced = &entry;
+            break;
+        }
+
+        int score;
+        if (data == 0)
+            score = -1;
+        else
+            score = unpackDraft(data) + (unpackAge(data) == age ? 256 : 0);
+
+        if (replaced == nullptr || score < replacedScore)
+        {
+            replaced = &entry;
+            replacedScore = score;
+        }
+    }
+
+    const std::uint64_t data = packData(value, draft, age);
+    replaced->keyXorData.store(static_cast<std::uint64_t>(key) ^ data, std::memory_order_relaxed);
+    replaced->data.store(data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::newSearch()
+{
+    age++;
+}
+
+void TranspositionTable::clear()
+{
+    std::memset(static_cast<void*>(buckets), 0, (bucketMask + 1) * sizeof(Bucket));
+}
+
+std::size_t TranspositionTable::getCapacity() const
+{
+    return (bucketMask + 1) * BUCKET_SIZE;
+}
+
+std::size_t TranspositionTable::getEntryCount() const
+{
+    std::size_t entryCount = 0;
+    forEach([&entryCount](long long, const CacheValue&) { entryCount++; });
+    return entryCount;
+}
+
+std::uint64_t TranspositionTable::getChecksum(const void* data, std::size_t size, std::uint64_t checksum)
+{
+    // FNV-1a over 64 bit words, size is a multiple of 8
+    const std::uint64_t* words = static_cast<const std::uint64_t*>(data);
+    for (std::size_t i = 0; i < size / sizeof(std::uint64_t); i++)
+        checksum = (checksum ^ words[i]) * 0x100000001B3ULL;
+    return checksum;
+}
+
+std::uint64_t TranspositionTable::getHeaderChecksum(const FileHeader& header)
+{
+    FileHeader checkedHeader = header;
+    checkedHeader.headerChecksum = 0;
+    return getChecksum(&checkedHeader, sizeof(checkedHeader));
+}
+
+bool TranspositionTable::isValidHeader(const FileHeader& header)
+{
+    return std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0
+        && header.formatVersion == FILE_FORMAT_VERSION && header.keyVersion == KEY_VERSION
+        && header.entrySize == sizeof(Entry) && header.headerChecksum == getHeaderChecksum(header)
+        && header.bucketCount != 0 && (header.bucketCount & (header.bucketCount - 1)) == 0;
+}
+
+bool TranspositionTable::save(const std::string& path) const
+{
+    const std::size_t bucketsSize = (bucketMask + 1) * sizeof(Bucket);
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.formatVersion = FILE_FORMAT_VERSION;
+    header.keyVersion = KEY_VERSION;
+    header.entrySize = sizeof(Entry);
+    header.bucketCount = bucketMask + 1;
+    header.entryCount = getEntryCount();
+    header.dataChecksum = getChecksum(buckets, bucketsSize);
+    header.age = age;
+    header.headerChecksum = getHeaderChecksum(header);
+
+    // written aside and renamed, as the table may be mapped from the file at path, and truncating it would break the mapping
+    const std::string writtenPath = path + ".tmp";
+    std::ofstream file{ writtenPath, std::ios_base::binary | std::ios_base::trunc };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // pages never written are left as holes, so a table mostly empty takes little disk
+    constexpr std::size_t HOLE_SIZE = 4096;
+    const char* data = reinterpret_cast<const char*>(buckets);
+    static const char zeroPage[HOLE_SIZE] = {};
+    for (std::size_t offset = 0; offset < bucketsSize; offset += HOLE_SIZE)
+    {
+        const std::size_t size = std::min(HOLE_SIZE, bucketsSize - offset);
+        if (std::memcmp(data + offset, zeroPage, size) == 0 && offset + size < bucketsSize)
+            file.seekp(static_cast<std::streamoff>(size), std::ios_base::cur);
+        else
+            file.write(data + offset, static_cast<std::streamsize>(size));
+    }
+    file.close();
+    if (!file)
+        return false;
+    return std::rename(writtenPath.c_str(), path.c_str()) == 0;
+}
+
+void TranspositionTable::storeEntries(const Bucket* fileBuckets, std::uint64_t bucketCount)
+{
+    for (std::uint64_t bucketIndex = 0; bucketIndex < bucketCount; bucketIndex++)
+    {
+        for (const Entry& entry : fileBuckets[bucketIndex].entries)
+        {
+            const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+            const std::uint64_t key = entry.keyXorData.load(std::memory_order_relaxed) ^ data;
+            if (data != 0)
+                store(static_cast<long long>(key), unpackValue(data), unpackDraft(data));
+        }
+    }
+}
+
+bool TranspositionTable::load(const std::string& path, bool isVerified)
+{
+    FileHeader header;
+#ifdef __linux__
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    const bool isRead = fstat(file, &status) == 0 && pread(file, &header, sizeof(header), 0) == sizeof(header);
+#else
+    std::ifstream file{ path, std::ios_base::binary };
+    const bool isRead = static_cast<bool>(file.read(reinterpret_cast<char*>(&header), sizeof(header)));
+#endif
+
+    const bool isValid = isRead && isValidHeader(header);
+    const std::size_t bucketsSize = isValid ? header.bucketCount * sizeof(Bucket) : 0;
+
+#ifdef __linux__
+    if (!isValid || static_cast<std::size_t>(status.st_size) != sizeof(FileHeader) + bucketsSize)
+    {
+        close(file);
+        return false;
+    }
+    void* mapped = mmap(nullptr, sizeof(FileHeader) + bucketsSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+        return false;
+    Bucket* mappedBuckets = reinterpret_cast<Bucket*>(static_cast<char*>(mapped) + sizeof(FileHeader));
+    if (isVerified && getChecksum(mappedBuckets, bucketsSize) != header.dataChecksum)
+    {
+        munmap(mapped, sizeof(FileHeader) + bucketsSize);
+        return false;
+    }
+    if (header.bucketCount <= bucketMask)
+    {
+        storeEntries(mappedBuckets, header.bucketCount);
+        munmap(mapped, sizeof(FileHeader) + bucketsSize);
+        return true;
+    }
+    munmap(allocated, allocatedSize);
+    allocated = mapped;
+    allocatedSize = sizeof(FileHeader) + bucketsSize;
+    buckets = mappedBuckets;
+#else
+    if (!isValid)
+        return false;
+    void* loaded = std::calloc(header.bucketCount + 1, sizeof(Bucket));
+    if (loaded == nullptr)
+        return false;
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(loaded);
+    address = (address + alignof(Bucket) - 1) & ~static_cast<std::uintptr_t>(alignof(Bucket) - 1);
+    Bucket* loadedBuckets = reinterpret_cast<Bucket*>(address);
+    if (!file.read(reinterpret_cast<char*>(loadedBuckets), bucketsSize)
+        || (isVerified && getChecksum(loadedBuckets, bucketsSize) != header.dataChecksum))
+    {
+        std::free(loaded);
+        return false;
+    }
+    if (header.bucketCount <= bucketMask)
+    {
+        storeEntries(loadedBuckets, header.bucketCount);
+        std::free(loaded);
+        return true;
+    }
+    std::free(allocated);
+    allocated = loaded;
+    buckets = loadedBuckets;
+#endif
+    bucketMask = header.bucketCount - 1;
+    // the entries of the file count as older searches
+    age = static_cast<std::uint8_t>(header.age + 1);
+    return true;
+}
+
+namespace
+{
+    struct MergeRecord
+    {
+        // in the merged table
+        std::uint64_t bucketIndex;
+        long long key;
+        std::uint64_t data;
+    };
+
+    bool isRecordLess(const MergeRecord& left, const MergeRecord& right)
+    {
+        if (left.bucketIndex != right.bucketIndex)
+            return left.bucketIndex < right.bucketIndex;
+        return left.key < right.key;
+    }
+
+    bool writeRun(std::vector<MergeRecord>& run, const std::string& path)
+    {
+        std::sort(run.begin(), run.end(), isRecordLess);
+        std::ofstream file{ path, std::ios_base::binary | std::ios_base::trunc };
+        file.write(reinterpret_cast<const char*>(run.data()), static_cast<std::streamsize>(run.size() * sizeof(MergeRecord)));
+        run.clear();
+        return static_cast<bool>(file);
+    }
+}
+
+bool TranspositionTable::merge(const std::vector<std::string>& inputPaths, const std::string& outputPath)
+{
+    // the merged table is at most half full with the entries of the headers, as a position in several files counts once
+    std::uint64_t inputEntryCount = 0;
+    for (const std::string& inputPath : inputPaths)
+    {
+        FileHeader header;
+        std::ifstream input{ inputPath, std::ios_base::binary };
+        if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) || !isValidHeader(header))
+            return false;
+        inputEntryCount += header.entryCount;
+    }
+    std::uint64_t bucketCount = 1;
+    while (bucketCount * BUCKET_SIZE < inputEntryCount * 2)
+        bucketCount *= 2;
+
+    std::vector<std::string> runPaths;
+    std::vector<MergeRecord> run;
+    bool isMerged = true;
+    for (const std::string& inputPath : inputPaths)
+    {
+        TranspositionTable input(sizeof(Bucket));
+        if (!input.load(inputPath, true))
+        {
+            isMerged = false;
+            break;
+        }
+        input.forEachData([&](long long key, std::uint64_t data)
+            {
+                run.push_back({ mixKey(static_cast<std::uint64_t>(key)) & (bucketCount - 1), key, data });
+                if (run.size() == MERGE_RUN_SIZE)
+                {
+                    runPaths.push_back(outputPath + ".run" + std::to_string(runPaths.size()));
+                    isMerged = writeRun(run, runPaths.back()) && isMerged;
+                }
+            });
+    }
+    if (isMerged && !run.empty())
+    {
+        runPaths.push_back(outputPath + ".run" + std::to_string(runPaths.size()));
+        isMerged = writeRun(run, runPaths.back());
+    }
+    run = {};
+
+    if (isMerged)
+        isMerged = writeMergedTable(runPaths, outputPath, bucketCount);
+    for (const std::string& runPath : runPaths)
+        std::remove(runPath.c_str());
+    return isMerged;
+}
+
+bool TranspositionTable::writeMergedTable(const std::vector<std::string>& runPaths, const std::string& outputPath, std::uint64_t bucketCount)
+{
+    // the smallest first record of the runs, k-way
+    using RunHead = std::pair<MergeRecord, std::size_t>;
+    auto isHeadAfter = [](const RunHead& left, const RunHead& right) { return isRecordLess(right.first, left.first); };
+    std::priority_queue<RunHead, std::vector<RunHead>, decltype(isHeadAfter)> heads(isHeadAfter);
+    std::vector<std::ifstream> runs;
+    runs.reserve(runPaths.size());
+    auto readHead = [&runs, &heads](std::size_t runIndex)
+        {
+            MergeRecord record;
+            if (runs[runIndex].read(reinterpret_cast<char*>(&record), sizeof(record)))
+                heads.push({ record, runIndex });
+        };
+    for (std::size_t runIndex = 0; runIndex < runPaths.size(); runIndex++)
+    {
+        runs.emplace_back(runPaths[runIndex], std::ios_base::binary);
+        readHead(runIndex);
+    }
+
+    const std::string writtenPath = outputPath + ".tmp";
+    std::ofstream output{ writtenPath, std::ios_base::binary | std::ios_base::trunc };
+    FileHeader header{};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::uint64_t checksum = CHECKSUM_SEED;
+    std::uint64_t entryCount = 0;
+    // (draft, key, data) of the merged entries of a bucket, the most expensive BUCKET_SIZE are kept
+    std::vector<std::tuple<int, long long, std::uint64_t>> bucketEntries;
+    for (std::uint64_t bucketIndex = 0; bucketIndex < bucketCount; bucketIndex++)
+    {
+        bucketEntries.clear();
+        while (!heads.empty() && heads.top().first.bucketIndex == bucketIndex)
+        {
+            const long long key = heads.top().first.key;
+            Utility lowerBound = UTILITY_MIN;
+            Utility upperBound = UTILITY_MAX;
+            int draft = -1;
+            signed char bestMove = -1;
+            while (!heads.empty() && heads.top().first.bucketIndex == bucketIndex && heads.top().first.key == key)
+            {
+                const auto [record, runIndex] = heads.top();
+                heads.pop();
+                readHead(runIndex);
+
+                const CacheValue value = unpackValue(record.data);
+                lowerBound = std::max(lowerBound, value.lowerBound);
+                upperBound = std::min(upperBound, value.upperBound);
+                if (unpackDraft(record.data) > draft || bestMove == -1)
+                {
+                    draft = std::max(draft, unpackDraft(record.data));
+                    if (value.bestMove != -1)
+                        bestMove = value.bestMove;
+                }
+            }
+            // disjoint bounds come from a damaged file, neither is kept
+            if (lowerBound > upperBound || (lowerBound <= LOSS && upperBound >= WIN))
+                continue;
+            bucketEntries.emplace_back(draft, key, packData({ lowerBound, upperBound, bestMove }, draft, 0));
+        }
+
+        std::sort(bucketEntries.begin(), bucketEntries.end(), std::greater<>());
+        std::array<std::uint64_t, BUCKET_SIZE * 2> words{};
+        static_assert(sizeof(words) == sizeof(Bucket), "a bucket is its entries");
+        for (std::size_t i = 0; i < bucketEntries.size() && i < BUCKET_SIZE; i++)
+        {
+            const auto& [draft, key, data] = bucketEntries[i];
+            words[i * 2] = static_cast<std::uint64_t>(key) ^ data;
+            words[i * 2 + 1] = data;
+            entryCount++;
+        }
+        checksum = getChecksum(words.data(), sizeof(words), checksum);
+        output.write(reinterpret_cast<const char*>(words.data()), sizeof(words));
+    }
+
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.formatVersion = FILE_FORMAT_VERSION;
+    header.keyVersion = KEY_VERSION;
+    header.entrySize = sizeof(Entry);
+    header.bucketCount = bucketCount;
+    header.entryCount = entryCount;
+    header.dataChecksum = checksum;
+    header.headerChecksum = getHeaderChecksum(header);
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    if (!output)
+        return false;
+    return std::rename(writtenPath.c_str(), outputPath.c_str()) == 0;
+}
+
+double TranspositionTable::getFillRate() const
+{
+    constexpr std::size_t SAMPLE_BUCKET_COUNT = 4096;
+    const std::size_t sampleBucketCount = std::min(SAMPLE_BUCKET_COUNT, bucketMask + 1);
+    std::size_t usedEntryCount = 0;
+    for (std::size_t bucketIndex = 0; bucketIndex < sampleBucketCount; bucketIndex++)
+    {
+        for (const Entry& entry : buckets[bucketIndex].entries)
+        {
+            if (entry.data.load(std::memory_order_relaxed) != 0)
+                usedEntryCount++;
+        }
+    }
+    return static_cast<double>(usedEntryCount) / (sampleBucketCount * BUCKET_SIZE);
+}
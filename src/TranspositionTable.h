@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// canonical keys are not random, so spread them before using them as a hash
+std::uint64_t mixKey(std::uint64_t key);
+
+enum Utility :signed char { UTILITY_MIN = -2, LOSS = -1, DRAW = 0, WIN = 1, UTILITY_MAX = 2 };
+
+struct CacheValue
+{
+    Utility lowerBound;
+    Utility upperBound;
+    // piece or square in the canonical form, -1 if unknown
+    signed char bestMove = -1;
+};
+
+// fixed size open addressing table, keyed by Board::getNormalized.
+// lock-free : any number of threads can probe and store at the same time
+class TranspositionTable
+{
+private:
+    // key and packed data, 16 byte
+    struct Entry
+    {
+        // key ^ data, so an entry torn by two threads writing at once fails the key check
+        std::atomic<std::uint64_t> keyXorData;
+        // lowerBound, upperBound, draft, age, bestMove. 0 means empty
+        std::atomic<std::uint64_t> data;
+    };
+
+    static constexpr int BUCKET_SIZE = 4;
+    struct alignas(64) Bucket
+    {
+        std::array<Entry, BUCKET_SIZE> entries;
+    };
+
+    // the file of save : FileHeader, then the buckets as they are in memory
+    struct alignas(64) FileHeader
+    {
+        char magic[4];
+        std::uint32_t formatVersion;
+        // keys and buckets of another version mean other positions
+        std::uint32_t keyVersion;
+        std::uint32_t entrySize;
+        std::uint64_t bucketCount;
+        // used entries, for statistics
+        std::uint64_t entryCount;
+        std::uint64_t dataChecksum;
+        std::uint8_t age;
+        // of the header with headerChecksum 0
+        std::uint64_t headerChecksum;
+    };
+    static constexpr char FILE_MAGIC[4] = { 'Q', 'T', 'T', '1' };
+    static constexpr std::uint32_t FILE_FORMAT_VERSION = 1;
+    // bump when Board::getNormalized, mixKey or packData change
+    static constexpr std::uint32_t KEY_VERSION = 1;
+
+    static constexpr std::uint64_t CHECKSUM_SEED = 0xCBF29CE484222325ULL;
+    // checksum : of the data before, to continue it
+    static std::uint64_t getChecksum(const void* data, std::size_t size, std::uint64_t checksum = CHECKSUM_SEED);
+    static std::uint64_t getHeaderChecksum(const FileHeader& header);
+    static bool isValidHeader(const FileHeader& header);
+    // the entries of a file smaller than the table, stored one by one
+    void storeEntries(const Bucket* fileBuckets, std::uint64_t bucketCount);
+
+    // merge sorts this many entries at once in memory, 24 byte each
+    static constexpr std::size_t MERGE_RUN_SIZE = 1 << 24;
+    // the table file of bucketCount buckets from the runs of merge, each sorted by bucket then key
+    static bool writeMergedTable(const std::vector<std::string>& runPaths, const std::string& outputPath, std::uint64_t bucketCount);
+
+    void* allocated = nullptr;
+    std::size_t allocatedSize = 0;
+    Bucket* buckets = nullptr;
+    std::size_t bucketMask = 0;
+    std::uint8_t age = 0;
+
+    static std::uint64_t packData(const CacheValue& value, int draft, std::uint8_t age);
+    static CacheValue unpackValue(std::uint64_t data);
+    static int unpackDraft(std::uint64_t data);
+    static std::uint8_t unpackAge(std::uint64_t data);
+
+    Bucket& getBucket(long long key) const;
+
+    // function(key, packed data) for every used entry
+    template <typename Function>
+    void forEachData(Function function) const
+    {
+        for (std::size_t bucketIndex = 0; bucketIndex <= bucketMask; bucketIndex++)
+        {
+            for (const Entry& entry : buckets[bucketIndex].entries)
+            {
+                const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+                const std::uint64_t key = entry.keyXorData.load(std::memory_order_relaxed) ^ data;
+                if (data != 0)
+                    function(static_cast<long long>(key), data);
+            }
+        }
+    }
+
+public:
+    explicit TranspositionTable(std::size_t memorySize);
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    bool probe(long long key, CacheValue& value) const;
+    // draft : plies left until the board is full, used to keep the more expensive entry
+    void store(long long key, const CacheValue& value, int draft);
+    // entries from older searches are replaced first. call while no thread is searching
+    void newSearch();
+    void clear();
+
+    // call while no thread is searching. false : the file could not be written
+    bool save(const std::string& path) const;
+    // maps a file of save as the table, copy-on-write, so the table is usable at once and pages are read when probed.
+    // the size of the table becomes the size of the file, unless the file is smaller, like a merged one : then its
+    // entries are stored into the table. isVerified : also checks the checksum of the buckets, which reads the whole file.
+    // false : not a table of this version, or damaged, and the table is unchanged
+    bool load(const std::string& path, bool isVerified);
+    // merges files of save into one at outputPath, sized for the entries they hold. the bounds of a position
+    // in several files are intersected, which drops the wider ones, and entries without a bound are dropped.
+    // the entries are sorted in runs on disk, so the files may be larger than the memory.
+    // false : an input is not a valid table, or a file could not be written
+    static bool merge(const std::vector<std::string>& inputPaths, const std::string& outputPath);
+
+    std::size_t getCapacity() const;
+    std::size_t getEntryCount() const;
+    // estimated from the first buckets
+    double getFillRate() const;
+
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        forEachData([&function](long long key, std::uint64_t data) { function(key, unpackValue(data)); });
+    }
+};
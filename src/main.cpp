@@ -1,97 +1,338 @@
 #include "negamax.h"
 #include "MonteCarlo.h"
+#include "Benchmark.h"
+#include "TimeManager.h"
+#include "ThreadPool.h"
+#include "LineServer.h"
+#include "OpeningBook.h"
+#include "Tablebase.h"
+#include <algorithm>
 #include <iostream>
-#include <set>
 #include <array>
 #include <unordered_map>
 #include <fstream>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
 
 struct InputData
 {
     bool isPiecePlaceStep;
     int selectedPiece;
+    // 0 : the default time of the MCTS
+    int moveTimeMs = 0;
 };
 
-InputData readInput(Board& board, std::set<int>& availablePieces)
+// false : the input is not a position
+bool readInput(std::istream& inputStream, Board& board, PieceSet& availablePieces, InputData& input)
 {
-    board.setBoardFromStdin();
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        int piece;
+        if (!(inputStream >> piece) || piece < -1 || piece >= PIECE_COUNT)
+            return false;
+        board.set(square / BOARD_COLS, square % BOARD_COLS, piece);
+    }
 
     int availablePieceCount;
-    std::cin >> availablePieceCount;
+    if (!(inputStream >> availablePieceCount))
+        return false;
     for (int i = 0; i < availablePieceCount; i++)
     {
         int availablePiece;
-        std::cin >> availablePiece;
+        if (!(inputStream >> availablePiece) || availablePiece < 0 || availablePiece >= PIECE_COUNT)
+            return false;
         availablePieces.insert(availablePiece);
     }
 
-    InputData input;
-    std::cin >> input.isPiecePlaceStep;
+    if (!(inputStream >> input.isPiecePlaceStep))
+        return false;
     if (input.isPiecePlaceStep)
     {
-        std::cin >> input.selectedPiece;
+        if (!(inputStream >> input.selectedPiece) || input.selectedPiece < 0 || input.selectedPiece >= PIECE_COUNT)
+            return false;
     }
-    return input;
+
+    // optional : "move <ms>" for the time of this move, "clock <ms>" for the time left in the game
+    std::string timeControl;
+    if (!(inputStream >> timeControl))
+        return true;
+    int timeMs;
+    if (!(inputStream >> timeMs) || timeMs < 0)
+        return false;
+    if (timeControl == "move")
+        input.moveTimeMs = timeMs;
+    else if (timeControl == "clock")
+        input.moveTimeMs = TimeManager::getMoveTimeFromClock(timeMs, board.getFilledCount() * 2 + input.isPiecePlaceStep);
+    else
+        return false;
+
+    std::string rest;
+    return !(inputStream >> rest);
 }
 
-void start()
+// what the process keeps between the requests of the daemon mode. the one-shot mode makes one per run
+struct SearchState
 {
-    static constexpr int NEGAMAX_START_DEPTH = 9;
+    // shared by the negamax and the exact leaves of the MCTS
+    std::shared_ptr<TranspositionTable> caches = std::make_shared<TranspositionTable>(Solver::CACHE_MEMORY_SIZE);
+    MCTSEngine mctsEngine{ MCTS_ARENA_MEMORY_SIZE, caches };
+    // the MCTS moves search a graph of canonical positions made for each move (selectPieceGraph), instead of mctsEngine.
+    // the graph is not kept between the moves, so there is no pondering with it
+    bool isGraphSearch = false;
+    // the MCTS searches the position after each answer until the next request
+    bool isPondering = false;
+    // set by a request, started once its response is written : moving the root of the tree takes time
+    std::function<void()> startPendingPondering;
+    // the caches start from this file, and the daemon saves them back when it stops. empty : no file
+    std::string cachePath;
+};
 
-    Board board;
-    std::set<int> availablePieces;
+// the caches are mapped from the file, so this costs no reading
+void loadCaches(SearchState& state, const std::string& cachePath)
+{
+    state.cachePath = cachePath;
+    if (cachePath.empty())
+        return;
+    if (!state.caches->load(cachePath, false))
+        std::cerr << "cannot load cache " << cachePath << '\n';
+}
+
+int searchMCTS(const Board& board, PieceSet availablePieces, const InputData& inputData, int moveTimeMs, SearchState& state)
+{
+    if (inputData.isPiecePlaceStep)
+    {
+        auto place = state.isGraphSearch ? placePieceGraph(board, availablePieces, inputData.selectedPiece, moveTimeMs)
+            : state.mctsEngine.placePiece(board, availablePieces, inputData.selectedPiece, moveTimeMs);
+        return place[0] * BOARD_COLS + place[1];
+    }
+    return state.isGraphSearch ? selectPieceGraph(board, availablePieces, moveTimeMs)
+        : state.mctsEngine.selectPiece(board, availablePieces, moveTimeMs);
+}
+
+// of the time limit of a negamax move, the rest is for the MCTS if the negamax runs out of time
+constexpr int NEGAMAX_TIME_SHARE_PERCENT = 75;
 
-    InputData inputData = readInput(board, availablePieces);
+// the piece to select, or the square to place on (row * BOARD_COLS + col)
+int answer(const Board& board, PieceSet availablePieces, const InputData& inputData, SearchState& state)
+{
+    int bookMove;
+    if (OpeningBook::getShared().probe(board, inputData.isPiecePlaceStep ? inputData.selectedPiece : -1, bookMove))
+    {
+        const bool isLegal = inputData.isPiecePlaceStep
+            ? board.get(bookMove / BOARD_COLS, bookMove % BOARD_COLS) == -1 : availablePieces.contains(bookMove);
+        if (isLegal)
+            return bookMove;
+    }
 
     if (board.getFilledCount() == 0)
     {
         if (inputData.isPiecePlaceStep)
-            std::cout << "0, 1";
+            return 1;
         else
-            std::cout << 0;
+            return 0;
     }
     else if (board.getFilledCount() * 2 + inputData.isPiecePlaceStep < NEGAMAX_START_DEPTH)
     {
-        if (inputData.isPiecePlaceStep)
-        {
-            auto place = placePieceParallel(board, availablePieces, inputData.selectedPiece);
-            std::cout << place[0] << ", " << place[1];
-        }
-        else
-        {
-            int solverSelect = selectPieceParallel(board, availablePieces);
-            std::cout << solverSelect;
-        }
+        return searchMCTS(board, availablePieces, inputData, inputData.moveTimeMs, state);
     }
     else
     {
-        Solver solver(board, availablePieces);
+        Solver solver(board, availablePieces, state.caches);
+        const int threadCount = ThreadPool::getShared().getThreadCount();
+        // with a time limit, the negamax gets most of it, and the MCTS answers with the rest if the negamax does not finish
+        const int negamaxTimeMs = inputData.moveTimeMs * NEGAMAX_TIME_SHARE_PERCENT / 100;
+        std::optional<StopTimer> stopTimer;
+        if (inputData.moveTimeMs > 0)
+        {
+            stopTimer.emplace(negamaxTimeMs);
+            solver.setStopFlag(stopTimer->getFlag());
+        }
         using namespace std::chrono;
         steady_clock::time_point starttime, endtime;
+        int result;
         if (inputData.isPiecePlaceStep)
         {
             starttime = steady_clock::now();
-            auto place = solver.placePiece(inputData.selectedPiece);
+            auto place = solver.placePieceParallel(inputData.selectedPiece, threadCount);
             endtime = steady_clock::now();
-            std::cout << place.first << ", " << place.second;
+            result = place.first * BOARD_COLS + place.second;
         }
         else
         {
             starttime = steady_clock::now();
-            int solverSelect = solver.selectPiece();
+            result = solver.selectPieceParallel(threadCount);
             endtime = steady_clock::now();
-            std::cout << solverSelect;
         }
         std::cerr << "minimax time : " << duration_cast<milliseconds>(endtime - starttime).count() << '\n';
+        solver.printCacheStatistics();
+
+        if (stopTimer.has_value() && stopTimer->isExpired())
+        {
+            std::cerr << "minimax out of time\n";
+            const int mctsTimeMs = std::max(TimeManager::MINIMUM_SEARCH_MS, inputData.moveTimeMs - negamaxTimeMs);
+            return searchMCTS(board, availablePieces, inputData, mctsTimeMs, state);
+        }
+        return result;
+    }
+}
+
+// output format : the piece, or "row, col"
+std::string formatAnswer(int move, bool isPiecePlaceStep)
+{
+    if (isPiecePlaceStep)
+        return std::to_string(move / BOARD_COLS) + ", " + std::to_string(move % BOARD_COLS);
+    return std::to_string(move);
+}
+
+// the opponent moves next : after a select, they place the piece. after a place, this side selects
+// and they place again, so the search starts from the board with the placed piece.
+// the next move of this side is searched by the negamax from NEGAMAX_START_DEPTH, so there is nothing to ponder then
+bool isPonderingUseful(const Board& board, const InputData& inputData)
+{
+    const int ply = board.getFilledCount() * 2 + inputData.isPiecePlaceStep;
+    const int nextPly = inputData.isPiecePlaceStep ? ply + 1 : ply + 3;
+    return nextPly < NEGAMAX_START_DEPTH;
+}
+
+void startPondering(Board board, PieceSet availablePieces, const InputData& inputData, int move, SearchState& state)
+{
+    if (inputData.isPiecePlaceStep)
+    {
+        board.set(move / BOARD_COLS, move % BOARD_COLS, inputData.selectedPiece);
+        availablePieces.erase(inputData.selectedPiece);
+        if (board.isWinnerExist() || board.isFull())
+            return;
+        state.mctsEngine.startPondering(board, availablePieces, -1);
+    }
+    else if (availablePieces.contains(move))
+    {
+        state.mctsEngine.startPondering(board, availablePieces, move);
+    }
+}
+
+void start(const std::string& cachePath, bool isGraphSearch)
+{
+    Board board;
+    PieceSet availablePieces;
+    InputData inputData;
+    if (!readInput(std::cin, board, availablePieces, inputData))
+    {
+        std::cerr << "invalid input\n";
+        return;
     }
+
+    SearchState state;
+    state.isGraphSearch = isGraphSearch;
+    loadCaches(state, cachePath);
+    std::cout << formatAnswer(answer(board, availablePieces, inputData, state), inputData.isPiecePlaceStep);
+}
+
+// daemon protocol, one line each way :
+// a position in the one-shot format, on one line -> the answer
+// "newgame" -> "ok", and the MCTS tree of the previous game is freed
+// "quit" -> "ok", and the daemon stops
+// anything else -> "error"
+bool handleRequest(const std::string& request, std::string& response, SearchState& state)
+{
+    // a search for the request starts from the pondering tree, or stops it at once
+    state.mctsEngine.stopPondering();
+    state.startPendingPondering = nullptr;
+
+    if (request == "quit")
+    {
+        if (!state.cachePath.empty() && !state.caches->save(state.cachePath))
+            std::cerr << "cannot save cache " << state.cachePath << '\n';
+        response = "ok";
+        return false;
+    }
+    if (request == "newgame")
+    {
+        state.mctsEngine.clear();
+        response = "ok";
+        return true;
+    }
+
+    std::istringstream requestStream(request);
+    Board board;
+    PieceSet availablePieces;
+    InputData inputData;
+    if (!readInput(requestStream, board, availablePieces, inputData))
+    {
+        response = "error";
+        return true;
+    }
+
+    const int move = answer(board, availablePieces, inputData, state);
+    response = formatAnswer(move, inputData.isPiecePlaceStep);
+    if (state.isPondering && !state.isGraphSearch && isPonderingUseful(board, inputData))
+    {
+        state.startPendingPondering = [board, availablePieces, inputData, move, &state]()
+            {
+                startPondering(board, availablePieces, inputData, move, state);
+            };
+    }
+    return true;
+}
+
+void serve(const std::string& socketPath, bool isPondering, bool isGraphSearch, const std::string& cachePath)
+{
+    SearchState state;
+    state.isPondering = isPondering;
+    state.isGraphSearch = isGraphSearch;
+    loadCaches(state, cachePath);
+    auto handle = [&state](const std::string& request, std::string& response)
+        {
+            return handleRequest(request, response, state);
+        };
+    auto onResponseSent = [&state]()
+        {
+            if (state.startPendingPondering)
+                state.startPendingPondering();
+            state.startPendingPondering = nullptr;
+        };
+
+    if (socketPath.empty())
+        serveStdio(handle, onResponseSent);
+    else if (!serveUnixSocket(socketPath, handle, onResponseSent))
+        std::cerr << "cannot serve on " << socketPath << '\n';
+}
+
+// the seeds from stdin, one position per line in the one-shot format
+void generateTablebase(int maxEmptyCount, const std::string& path)
+{
+    std::vector<TablebaseSeed> seeds;
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        std::istringstream lineStream(line);
+        TablebaseSeed seed;
+        InputData inputData;
+        if (!readInput(lineStream, seed.board, seed.availablePieces, inputData))
+        {
+            std::cerr << "invalid seed : " << line << '\n';
+            continue;
+        }
+        if (inputData.isPiecePlaceStep)
+            seed.selectedPiece = inputData.selectedPiece;
+        seeds.push_back(seed);
+    }
+    if (!buildTablebase(seeds, maxEmptyCount, path))
+        std::cerr << "cannot write " << path << '\n';
 }
 
 void MCTSStart()
 {
     Board board;
-    std::set<int> availablePieces;
+    PieceSet availablePieces;
 
-    InputData inputData = readInput(board, availablePieces);
+    InputData inputData;
+    if (!readInput(std::cin, board, availablePieces, inputData))
+        return;
 
     if (board.getFilledCount() == 0)
     {
@@ -104,20 +345,202 @@ void MCTSStart()
 
     if (inputData.isPiecePlaceStep)
     {
-        auto place = placePieceParallel(board, availablePieces, inputData.selectedPiece);
+        auto place = placePieceGraph(board, availablePieces, inputData.selectedPiece, inputData.moveTimeMs);
         std::cout << place[0] << ", " << place[1];
     }
     else
     {
-        int solverSelect = selectPieceParallel(board, availablePieces);
+        int solverSelect = selectPieceGraph(board, availablePieces, inputData.moveTimeMs);
         std::cout << solverSelect;
     }
 }
 
-int main()
+// false : text is not a whole non-negative number
+bool parseCount(const std::string& text, int& value)
 {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 9)
+        return false;
+    value = std::stoi(text);
+    return true;
+}
+
+void printUsage()
+{
+    std::cerr << "usage : QuartoCppCode.out [options] [mode [arguments]]\n"
+        "modes : (none) one position from stdin, daemon, bench, bench-mcts, bench-playout, bench-rave [rounds] [k],\n"
+        "        tablebase <max empty count> <path>, book <ply count> <move time ms> <path>,\n"
+        "        merge-cache <output path> <input path>...\n"
+        "options : --threads <count>, --pin, --socket <path>, --ponder, --graph, --tablebase <path>, --book <path>, --cache <path>\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // options : "--threads <count>" sizes the search threads (default : one per hardware thread),
+    // "--pin" pins each of them to a core, "--socket <path>" makes the daemon listen on a Unix socket,
+    // "--ponder" makes the daemon search on the opponent's time, "--graph" searches the MCTS moves on a graph of canonical positions,
+    // "--tablebase <path>" makes the negamax probe the tablebase,
+    // "--book <path>" answers the positions of the opening book without searching,
+    // "--cache <path>" starts the caches from a file saved by the daemon, which saves them back at "quit".
+    // the first other argument is the mode, none : one position from stdin. the rest are the arguments of the mode
+    std::string mode;
+    std::vector<std::string> modeArguments;
+    int threadCount = 0;
+    bool isPinned = false;
+    std::string socketPath;
+    bool isPondering = false;
+    bool isGraphSearch = false;
+    std::string tablebasePath;
+    std::string bookPath;
+    std::string cachePath;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--pin")
+            isPinned = true;
+        else if (argument == "--ponder")
+            isPondering = true;
+        else if (argument == "--graph")
+            isGraphSearch = true;
+        else if (argument == "--threads" && hasValue)
+        {
+            if (!parseCount(argv[++i], threadCount))
+            {
+                std::cerr << "invalid thread count : " << argv[i] << '\n';
+                return 1;
+            }
+        }
+        else if (argument == "--socket" && hasValue)
+            socketPath = argv[++i];
+        else if (argument == "--tablebase" && hasValue)
+            tablebasePath = argv[++i];
+        else if (argument == "--book" && hasValue)
+            bookPath = argv[++i];
+        else if (argument == "--cache" && hasValue)
+            cachePath = argv[++i];
+        else if (argument.rfind("--", 0) == 0)
+        {
+            std::cerr << "unknown option or missing value : " << argument << '\n';
+            printUsage();
+            return 1;
+        }
+        else if (mode.empty())
+            mode = argument;
+        else
+            modeArguments.push_back(argument);
+    }
+
+    // the modes without arguments, and the argument count of the others. bench-rave takes up to this many
+    static const std::unordered_map<std::string, int> MODE_ARGUMENT_COUNTS = {
+        { "", 0 }, { "daemon", 0 }, { "bench", 0 }, { "bench-mcts", 0 }, { "bench-playout", 0 }, { "bench-rave", 2 },
+        { "tablebase", 2 }, { "book", 3 },
+    };
+    const auto modeArgumentCount = MODE_ARGUMENT_COUNTS.find(mode);
+    bool isValidMode;
+    if (mode == "merge-cache")
+        isValidMode = modeArguments.size() >= 2;
+    else if (mode == "bench-rave")
+        isValidMode = static_cast<int>(modeArguments.size()) <= modeArgumentCount->second;
+    else
+        isValidMode = modeArgumentCount != MODE_ARGUMENT_COUNTS.end() && static_cast<int>(modeArguments.size()) == modeArgumentCount->second;
+    if (!isValidMode)
+    {
+        std::cerr << "unknown mode or wrong arguments : " << mode << '\n';
+        printUsage();
+        return 1;
+    }
+    ThreadPool::configureShared(threadCount, isPinned);
+    if (!tablebasePath.empty())
+    {
+        Tablebase::configureShared(tablebasePath);
+        if (Tablebase::getShared().getMaxEmptyCount() < 0)
+            std::cerr << "cannot open tablebase " << tablebasePath << '\n';
+        else
+            std::cerr << "tablebase positions : " << Tablebase::getShared().getEntryCount() << '\n';
+    }
+    if (!bookPath.empty())
+    {
+        OpeningBook::configureShared(bookPath);
+        if (OpeningBook::getShared().getEntryCount() == 0)
+            std::cerr << "cannot open book " << bookPath << '\n';
+    }
+
+    // "tablebase <max empty count> <path>" : solves the positions reachable from the seeds on stdin
+    if (mode == "tablebase")
+    {
+        int maxEmptyCount;
+        if (!parseCount(modeArguments[0], maxEmptyCount) || maxEmptyCount > SQUARE_COUNT)
+        {
+            std::cerr << "invalid max empty count : " << modeArguments[0] << '\n';
+            return 1;
+        }
+        generateTablebase(maxEmptyCount, modeArguments[1]);
+        return 0;
+    }
+    // "merge-cache <output path> <input path>..." : merges cache files saved by the daemon into one
+    if (mode == "merge-cache")
+    {
+        const std::vector<std::string> inputPaths(modeArguments.begin() + 1, modeArguments.end());
+        if (!TranspositionTable::merge(inputPaths, modeArguments[0]))
+        {
+            std::cerr << "cannot merge into " << modeArguments[0] << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    // "book <ply count> <move time ms> <path>" : searches the positions of the first plies, the plies of the negamax exactly
+    if (mode == "book")
+    {
+        int plyCount;
+        int moveTimeMs;
+        if (!parseCount(modeArguments[0], plyCount) || !parseCount(modeArguments[1], moveTimeMs))
+        {
+            std::cerr << "invalid ply count or move time\n";
+            return 1;
+        }
+        if (!buildOpeningBook(std::min(plyCount, SQUARE_COUNT * 2), moveTimeMs, modeArguments[2]))
+            std::cerr << "cannot write " << modeArguments[2] << '\n';
+        return 0;
+    }
+
+    if (mode == "daemon")
+    {
+        serve(socketPath, isPondering, isGraphSearch, cachePath);
+        return 0;
+    }
+
+    if (mode == "bench")
+    {
+        runNegamaxBenchmark();
+        return 0;
+    }
+    if (mode == "bench-mcts")
+    {
+        runMCTSBenchmark();
+        return 0;
+    }
+    if (mode == "bench-playout")
+    {
+        runPlayoutBenchmark();
+        return 0;
+    }
+    // "bench-rave [rounds] [k]" : rounds per position and side, and k of the RAVE side
+    if (mode == "bench-rave")
+    {
+        int roundCount = RAVE_BENCHMARK_ROUND_COUNT;
+        int raveEquivalence = RAVE_BENCHMARK_RAVE_EQUIVALENCE;
+        if ((modeArguments.size() > 0 && !parseCount(modeArguments[0], roundCount))
+            || (modeArguments.size() > 1 && !parseCount(modeArguments[1], raveEquivalence)))
+        {
+            std::cerr << "invalid round count or rave equivalence\n";
+            return 1;
+        }
+        runRaveBenchmark(roundCount, raveEquivalence);
+        return 0;
+    }
+
     //MCTSStart();
-    start();
+    start(cachePath, isGraphSearch);
     //takeSecondTurnCase();
     //system("pause");
 }
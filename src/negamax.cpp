@@ -1,23 +1,32 @@
 #include "negamax.h"
 
+#include <algorithm>
 #include <iostream>
-#include <fstream>
+#include <future>
+#include <mutex>
+#include <vector>
+#include "ThreadPool.h"
 
 
-Solver::Solver(const Board& board, const std::set<int>& availablePieces)
-    :board(board), availablePieces(availablePieces)
+Solver::Solver(const Board& board, PieceSet availablePieces, std::size_t cacheMemorySize)
+    :board(board), availablePieces(availablePieces), caches(std::make_shared<TranspositionTable>(cacheMemorySize))
 {
     if (LOAD_CACHE_FILE)
         loadCacheFile();
 }
 
+Solver::Solver(const Board& board, PieceSet availablePieces, std::shared_ptr<TranspositionTable> caches)
+    :board(board), availablePieces(availablePieces), caches(std::move(caches))
+{
+}
+
 Solver::~Solver()
 {
-    if (SAVE_CACHE_FILE)
+    if (SAVE_CACHE_FILE && threadIndex == 0)
         saveCacheFile();
 }
 
-void Solver::init(const Board& board, const std::set<int>& availablePieces)
+void Solver::init(const Board& board, PieceSet availablePieces)
 {
     this->board = board;
     this->availablePieces = availablePieces;
@@ -26,13 +35,10 @@ void Solver::init(const Board& board, const std::set<int>& availablePieces)
 void Solver::saveCacheFile()
 {
     std::cerr << "saving cache\n";
-    std::cerr << "saving cache count : " << caches.size() << '\n';
-    std::ofstream file{ CACHE_FILE_NAME, std::ios_base::binary };
-    for (const auto& cacheData : caches)
+    if (!caches->save(CACHE_FILE_NAME))
     {
-        file.write(reinterpret_cast<const char*>(&cacheData.first), sizeof(cacheData.first));
-        file.write(reinterpret_cast<const char*>(&cacheData.second.lowerBound), sizeof(cacheData.second.lowerBound));
-        file.write(reinterpret_cast<const char*>(&cacheData.second.upperBound), sizeof(cacheData.second.upperBound));
+        std::cerr << "cannot save cache\n";
+        return;
     }
     std::cerr << "cache saved\n";
 }
@@ -40,26 +46,60 @@ void Solver::saveCacheFile()
 void Solver::loadCacheFile()
 {
     std::cerr << "loading cache\n";
-    std::ifstream file{ CACHE_FILE_NAME, std::ios_base::binary };
-    while (file)
+    // the table is mapped, not read, so a missing or damaged file only leaves the table empty
+    if (!caches->load(CACHE_FILE_NAME, true))
     {
-        long long key;
-        CacheValue cacheValue;
-        file.read(reinterpret_cast<char*>(&key), sizeof(key));
-        file.read(reinterpret_cast<char*>(&cacheValue.lowerBound), sizeof(cacheValue.lowerBound));
-        file.read(reinterpret_cast<char*>(&cacheValue.upperBound), sizeof(cacheValue.upperBound));
-        caches[key] = cacheValue;
+        std::cerr << "cannot load cache\n";
+        return;
     }
     std::cerr << "cache loaded\n";
-    std::cerr << "loaded cache count : " << caches.size() << '\n';
+    std::cerr << "loaded cache count : " << caches->getEntryCount() << '\n';
+}
+
+void Solver::setMoveOrdering(bool useMoveOrdering)
+{
+    this->useMoveOrdering = useMoveOrdering;
+}
+
+void Solver::setVerbose(bool isVerbose)
+{
+    this->isVerbose = isVerbose;
+}
+
+void Solver::setStopFlag(const std::atomic<bool>* stopFlag)
+{
+    this->stopFlag = stopFlag;
 }
 
-bool Solver::readCache(int select, long long& normalizedBoard, Utility& alpha, Utility& beta, Utility& bestChildMinimax)
+std::size_t Solver::getNodeCount() const
 {
-    normalizedBoard = board.getNormalized(select);
-    auto cacheFound = caches.find(normalizedBoard);
-    const auto& cacheValue = cacheFound->second;
-    if (cacheFound != caches.end()) {
+    return nodeCount;
+}
+
+void Solver::printCacheStatistics() const
+{
+    const double hitRate = cacheProbeCount == 0 ? 0 : static_cast<double>(cacheHitCount) / cacheProbeCount;
+    std::cerr << "cache capacity : " << caches->getCapacity() << '\n';
+    std::cerr << "cache fill rate : " << caches->getFillRate() << ", hit rate : " << hitRate << '\n';
+    std::cerr << "enhanced transposition cutoffs : " << etcCutoffCount << '\n';
+}
+
+bool Solver::isStopped() const
+{
+    return (stopFlag != nullptr && stopFlag->load(std::memory_order_relaxed))
+        || (parallelStopFlag != nullptr && parallelStopFlag->load(std::memory_order_relaxed));
+}
+
+bool Solver::readCache(int select, long long& normalizedBoard, SymmetryTransform& transform, Utility& alpha, Utility& beta, Utility& bestChildMinimax, int& cachedMove)
+{
+    normalizedBoard = board.getNormalized(select, transform);
+    CacheValue cacheValue;
+    cacheProbeCount++;
+    if (caches->probe(normalizedBoard, cacheValue)) {
+        cacheHitCount++;
+        if (cacheValue.bestMove != -1)
+            cachedMove = select == -1 ? transform.fromCanonicalPiece(cacheValue.bestMove) : transform.fromCanonicalSquare(cacheValue.bestMove);
+
         if (cacheValue.lowerBound == cacheValue.upperBound) {
             bestChildMinimax = cacheValue.lowerBound;
             return true;
@@ -81,16 +121,10 @@ bool Solver::readCache(int select, long long& normalizedBoard, Utility& alpha, U
     return false;
 }
 
-void Solver::saveCache(long long normalizedBoard, Utility bestChildMinimax, Utility alphaOrig, Utility beta)
+void Solver::saveCache(long long normalizedBoard, const SymmetryTransform& transform, int select, int depth, Utility bestChildMinimax, int bestMove, Utility alphaOrig, Utility beta)
 {
     CacheValue newCacheValue{ UTILITY_MIN, UTILITY_MAX };
-
-    auto cacheIter = caches.find(normalizedBoard);
-    if (cacheIter != caches.end())
-    {
-        newCacheValue.lowerBound = cacheIter->second.lowerBound;
-        newCacheValue.upperBound = cacheIter->second.upperBound;
-    }
+    caches->probe(normalizedBoard, newCacheValue);
 
     if (bestChildMinimax <= alphaOrig)
         newCacheValue.upperBound = std::min(newCacheValue.upperBound, bestChildMinimax);
@@ -99,121 +133,326 @@ void Solver::saveCache(long long normalizedBoard, Utility bestChildMinimax, Util
     else
         newCacheValue.upperBound = newCacheValue.lowerBound = bestChildMinimax;
 
-    if (cacheIter == caches.end())
-        caches.insert({ normalizedBoard, newCacheValue });
+    if (bestMove != -1)
+        newCacheValue.bestMove = static_cast<signed char>(select == -1 ? transform.toCanonicalPiece(bestMove) : transform.toCanonicalSquare(bestMove));
+
+    caches->store(normalizedBoard, newCacheValue, PIECE_COUNT * 2 - depth);
+}
+
+void Solver::sortMoves(std::array<int, SQUARE_COUNT>& moves, std::array<long long, SQUARE_COUNT>& scores, int count)
+{
+    // insertion sort, stable so that ties keep the thread's visiting order
+    for (int i = 1; i < count; i++)
+    {
+        const int move = moves[i];
+        const long long score = scores[i];
+        int j = i - 1;
+        for (; j >= 0 && scores[j] < score; j--)
+        {
+            moves[j + 1] = moves[j];
+            scores[j + 1] = scores[j];
+        }
+        moves[j + 1] = move;
+        scores[j + 1] = score;
+    }
+}
+
+long long Solver::getOrderScore(int ply, int move, int cachedMove, int tacticalScore, long long history) const
+{
+    int primaryScore = tacticalScore + ORDER_TACTICAL_RANGE / 2;
+    if (move == cachedMove)
+        primaryScore += ORDER_TACTICAL_RANGE;
+    // killer moves only break ties, above them they cost more cutoffs than they bring
+    int killerScore = 0;
+    if (move == killerMoves[ply][1])
+        killerScore = 1;
+    if (move == killerMoves[ply][0])
+        killerScore = 2;
+    return static_cast<long long>(primaryScore) << (ORDER_HISTORY_BITS + 2)
+        | static_cast<long long>(killerScore) << ORDER_HISTORY_BITS
+        | std::min(history, (1LL << ORDER_HISTORY_BITS) - 1);
+}
+
+void Solver::orderPieces(std::array<int, SQUARE_COUNT>& pieces, int count, int ply, int cachedMove) const
+{
+    if (count == 0)
+        return;
+    if (threadIndex != 0)
+        std::rotate(pieces.begin(), pieces.begin() + threadIndex % count, pieces.begin() + count);
+    if (!useMoveOrdering)
+        return;
+
+    // pieces the opponent can place safely on the fewest squares first
+    const bool useTacticalHint = board.getFilledCount() < TACTICAL_HINT_FILLED_COUNT;
+    std::array<long long, SQUARE_COUNT> scores;
+    for (int i = 0; i < count; i++)
+    {
+        const int piece = pieces[i];
+        const int tacticalScore = useTacticalHint ? -board.getSafePlaceCount(piece) : 0;
+        scores[i] = getOrderScore(ply, piece, cachedMove, tacticalScore, selectHistory[piece]);
+    }
+    sortMoves(pieces, scores, count);
+}
+
+void Solver::orderSquares(std::array<int, SQUARE_COUNT>& squares, int count, int ply, int cachedMove, int selectedPiece) const
+{
+    if (count == 0)
+        return;
+    if (threadIndex != 0)
+        std::rotate(squares.begin(), squares.begin() + (threadIndex * 5) % count, squares.begin() + count);
+    if (!useMoveOrdering)
+        return;
+
+    // squares that make the most terminator traits and block the fewest live lines first.
+    // they leave the opponent fewer safe pieces, so the cutoffs come sooner
+    const bool useTacticalHint = board.getFilledCount() < TACTICAL_HINT_FILLED_COUNT;
+    std::array<long long, SQUARE_COUNT> scores;
+    for (int i = 0; i < count; i++)
+    {
+        const int square = squares[i];
+        const int tacticalScore = useTacticalHint ? -board.getPlaceScore(square / BOARD_COLS, square % BOARD_COLS, selectedPiece) : 0;
+        scores[i] = getOrderScore(ply, square, cachedMove, tacticalScore, placeHistory[selectedPiece][square]);
+    }
+    sortMoves(squares, scores, count);
+}
+
+void Solver::updateOrderStatistics(int ply, int move, int selectedPiece)
+{
+    if (killerMoves[ply][0] != move)
+    {
+        killerMoves[ply][1] = killerMoves[ply][0];
+        killerMoves[ply][0] = move;
+    }
+    const int draft = PIECE_COUNT * 2 - ply;
+    if (selectedPiece == -1)
+        selectHistory[move] += draft * draft;
     else
-        cacheIter->second = newCacheValue;
+        placeHistory[selectedPiece][move] += draft * draft;
+}
+
+int Solver::getSelectMoves(std::array<int, SQUARE_COUNT>& pieces, bool& hasTerminatorPiece) const
+{
+    // equivalent pieces lead to the same canonical position, so one per orbit is enough.
+    // a terminator piece has only terminator pieces in its orbit
+    PieceSet candidates = availablePieces;
+    if (board.getFilledCount() < SYMMETRY_PRUNING_FILLED_COUNT)
+        candidates = PieceSet(board.getDistinctPieces(availablePieces.getMask()));
+
+    int count = 0;
+    hasTerminatorPiece = false;
+    for (int availablePiece : candidates)
+    {
+        if (board.hasTerminatorTrait(availablePiece))
+            hasTerminatorPiece = true;
+        else
+            pieces[count++] = availablePiece;
+    }
+    return count;
+}
+
+int Solver::getPlaceMoves(std::array<int, SQUARE_COUNT>& squares, int selectedPiece) const
+{
+    SquareMask candidates = static_cast<SquareMask>(~board.getOccupied());
+    if (board.getFilledCount() < SYMMETRY_PRUNING_FILLED_COUNT)
+        candidates = board.getDistinctPlaces(selectedPiece);
+
+    int count = 0;
+    for (int square = 0; square < SQUARE_COUNT; square++)
+    {
+        if (candidates & (1u << square))
+            squares[count++] = square;
+    }
+    return count;
+}
+
+bool Solver::findTranspositionCutoff(int selectedPiece, const std::array<int, SQUARE_COUNT>& squares, int count, Utility beta, Utility& cutoffMinimax, int& cutoffSquare)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const int row = squares[i] / BOARD_COLS;
+        const int col = squares[i] % BOARD_COLS;
+        board.set(row, col, selectedPiece);
+        // symmetric children share the canonical key, so they are found as well
+        CacheValue childValue;
+        const bool isCached = caches->probe(board.getNormalized(-1), childValue);
+        board.set(row, col, -1);
+
+        // negamaxPlace takes negamaxSelect's value as it is, the same player moves next
+        if (isCached && childValue.lowerBound >= beta)
+        {
+            cutoffMinimax = childValue.lowerBound;
+            cutoffSquare = squares[i];
+            return true;
+        }
+    }
+    return false;
 }
 
 Utility Solver::negamaxSelect(Utility alpha, Utility beta)
 {
+    nodeCount++;
+
     // check terminal state
     if (board.isWinnerExist())
         return WIN;
     if (availablePieces.empty())
         return DRAW;
 
+    if (SQUARE_COUNT - board.getFilledCount() <= tablebase->getMaxEmptyCount())
+    {
+        Utility tablebaseValue;
+        if (tablebase->probe(board.getNormalized(-1), tablebaseValue))
+            return tablebaseValue;
+    }
+
     Utility bestChildMinimax = UTILITY_MIN;
+    const int ply = board.getFilledCount() * 2;
 
     // read cache
     long long normalizedBoard;
-    bool cacheFound = false;
-    if (board.getFilledCount() * 2 < unNomarlizedDepth) {
-        if (readCache(-1, normalizedBoard, alpha, beta, bestChildMinimax)) {
+    SymmetryTransform transform;
+    int cachedMove = -1;
+    if (ply < unNomarlizedDepth) {
+        if (readCache(-1, normalizedBoard, transform, alpha, beta, bestChildMinimax, cachedMove)) {
             return bestChildMinimax;
         }
     }
 
     Utility alphaOrig = alpha;
 
+    // terminator piece ָ ٷ й
+    std::array<int, SQUARE_COUNT> pieces;
+    bool hasTerminatorPiece;
+    const int pieceCount = getSelectMoves(pieces, hasTerminatorPiece);
+    if (hasTerminatorPiece)
+        bestChildMinimax = LOSS;
+    orderPieces(pieces, pieceCount, ply, cachedMove);
+
     // calculate child minimax
-    for (auto iter = availablePieces.begin(); iter != availablePieces.end(); ++iter)
+    int bestPiece = -1;
+    for (int i = 0; i < pieceCount; i++)
     {
-        int availablePiece = *iter;
-        Utility childMinimax;
-        if (board.hasTerminatorTrait(availablePiece))
-        {
-            childMinimax = LOSS;
-        }
-        else {
-            childMinimax = static_cast<Utility>(-negamaxPlace(availablePiece, static_cast<Utility>(-beta), static_cast<Utility>(-alpha)));
-            // iter ȿȭ 
-            iter = availablePieces.find(availablePiece);
-        }
+        const int availablePiece = pieces[i];
+        Utility childMinimax = static_cast<Utility>(-negamaxPlace(availablePiece, static_cast<Utility>(-beta), static_cast<Utility>(-alpha)));
+        // ٸ thread ´ٸ  ҿϹǷ cache  
+        if (isStopped())
+            return UTILITY_MIN;
 
         if (childMinimax > bestChildMinimax)
         {
             bestChildMinimax = childMinimax;
+            bestPiece = availablePiece;
             if (bestChildMinimax >= beta)
+            {
+                updateOrderStatistics(ply, availablePiece, -1);
                 break;
+            }
             alpha = std::max(alpha, bestChildMinimax);
         }
     }
 
     // save cache
-    if (board.getFilledCount() * 2 < unNomarlizedDepth)
-        saveCache(normalizedBoard, bestChildMinimax, alphaOrig, beta);
+    if (ply < unNomarlizedDepth)
+        saveCache(normalizedBoard, transform, -1, ply, bestChildMinimax, bestPiece, alphaOrig, beta);
 
     return bestChildMinimax;
 }
 
 Utility Solver::negamaxPlace(int selectedPiece, Utility alpha, Utility beta)
 {
+    nodeCount++;
+
     Utility bestChildMinimax = UTILITY_MIN;
+    const int ply = board.getFilledCount() * 2 + 1;
 
     // read cache
     long long normalizedBoard;
-    if (board.getFilledCount() * 2 + 1 < unNomarlizedDepth) {
-        if (readCache(selectedPiece, normalizedBoard, alpha, beta, bestChildMinimax))
+    SymmetryTransform transform;
+    int cachedMove = -1;
+    if (ply < unNomarlizedDepth) {
+        if (readCache(selectedPiece, normalizedBoard, transform, alpha, beta, bestChildMinimax, cachedMove))
             return bestChildMinimax;
     }
 
     Utility alphaOrig = alpha;
 
+    std::array<int, SQUARE_COUNT> squares;
+    const int squareCount = getPlaceMoves(squares, selectedPiece);
+
+    // enhanced transposition cutoff : a child already known to refute the window ends the node without descending
+    if (ply + 1 < unNomarlizedDepth && PIECE_COUNT * 2 - ply >= ETC_MIN_DRAFT)
+    {
+        int cutoffSquare;
+        if (findTranspositionCutoff(selectedPiece, squares, squareCount, beta, bestChildMinimax, cutoffSquare))
+        {
+            etcCutoffCount++;
+            if (ply < unNomarlizedDepth)
+                saveCache(normalizedBoard, transform, selectedPiece, ply, bestChildMinimax, cutoffSquare, alphaOrig, beta);
+            return bestChildMinimax;
+        }
+    }
+
+    orderSquares(squares, squareCount, ply, cachedMove, selectedPiece);
+
     availablePieces.erase(selectedPiece);
     // erase Ƿ insert ϱ  returnǸ ȵ
 
-    for (int row = 0; row < BOARD_ROWS; row++)
+    int bestSquare = -1;
+    for (int i = 0; i < squareCount; i++)
     {
-        for (int col = 0; col < BOARD_COLS; col++)
+        const int square = squares[i];
+        const int row = square / BOARD_COLS;
+        const int col = square % BOARD_COLS;
+        board.set(row, col, selectedPiece);
+        Utility childMinimax = negamaxSelect(alpha, beta);
+        board.set(row, col, -1);
+
+        if (isStopped())
+        {
+            availablePieces.insert(selectedPiece);
+            return UTILITY_MIN;
+        }
+
+        if (childMinimax > bestChildMinimax)
         {
-            if (board.get(row, col) == -1)
+            bestChildMinimax = childMinimax;
+            bestSquare = square;
+            if (bestChildMinimax >= beta)
             {
-                board.set(row, col, selectedPiece);
-                Utility childMinimax = negamaxSelect(alpha, beta);
-                board.set(row, col, -1);
-
-                if (childMinimax > bestChildMinimax)
-                {
-                    bestChildMinimax = childMinimax;
-                    if (bestChildMinimax >= beta)
-                        goto loopBreak;
-                    alpha = std::max(alpha, bestChildMinimax);
-                }
+                updateOrderStatistics(ply, square, selectedPiece);
+                break;
             }
+            alpha = std::max(alpha, bestChildMinimax);
         }
     }
-loopBreak:
 
     availablePieces.insert(selectedPiece);
 
     // save cache
-    if (board.getFilledCount() * 2 + 1 < unNomarlizedDepth) {
-        saveCache(normalizedBoard, bestChildMinimax, alphaOrig, beta);
+    if (ply < unNomarlizedDepth) {
+        saveCache(normalizedBoard, transform, selectedPiece, ply, bestChildMinimax, bestSquare, alphaOrig, beta);
     }
     return bestChildMinimax;
 }
 
-int Solver::selectPiece()
+Utility Solver::searchSelect(int& bestPiece, Utility alpha, Utility beta)
 {
-    int bestPiece;
     Utility bestChildMinimax = UTILITY_MIN;
-    Utility alpha = LOSS;
-    Utility beta = WIN;
 
-    for (auto iter = availablePieces.begin(); iter != availablePieces.end(); ++iter)
+    std::array<int, SQUARE_COUNT> pieces;
+    bool hasTerminatorPiece;
+    int pieceCount = getSelectMoves(pieces, hasTerminatorPiece);
+    orderPieces(pieces, pieceCount, board.getFilledCount() * 2, -1);
+    // terminator piece  LOSS Ȯ
+    for (int availablePiece : availablePieces)
+    {
+        if (board.hasTerminatorTrait(availablePiece))
+            pieces[pieceCount++] = availablePiece;
+    }
+
+    for (int i = 0; i < pieceCount; i++)
     {
-        int availablePiece = *iter;
+        const int availablePiece = pieces[i];
         Utility childMinimax;
         if (board.hasTerminatorTrait(availablePiece))
         {
@@ -221,66 +460,220 @@ int Solver::selectPiece()
         }
         else {
             childMinimax = static_cast<Utility>(-negamaxPlace(availablePiece, static_cast<Utility>(-beta), static_cast<Utility>(-alpha)));
-            iter = availablePieces.find(availablePiece);
+            if (isStopped())
+                break;
         }
 
-        std::cerr << "availablePiece : " << availablePiece << ", minimax : " << static_cast<int>(childMinimax) << '\n';
+        if (threadIndex == 0 && isVerbose)
+            std::cerr << "availablePiece : " << availablePiece << ", minimax : " << static_cast<int>(childMinimax) << '\n';
 
         if (childMinimax > bestChildMinimax)
         {
             bestChildMinimax = childMinimax;
             bestPiece = availablePiece;
-            if (bestChildMinimax == WIN)
+            if (bestChildMinimax >= beta)
                 break;
             alpha = std::max(alpha, bestChildMinimax);
         }
     }
 
-    return bestPiece;
+    return bestChildMinimax;
 }
 
-std::pair<int, int> Solver::placePiece(int selectedPiece)
+Utility Solver::searchPlace(int selectedPiece, std::pair<int, int>& bestPlace, Utility alpha, Utility beta)
 {
     availablePieces.erase(selectedPiece);
 
-    std::pair bestPlace = { 0,0 };
+    bestPlace = { 0,0 };
     Utility bestChildMinimax = UTILITY_MIN;
-    Utility alpha = LOSS;
-    Utility beta = WIN;
-    //if (board.getFilledCount() <= 3)
-    //    beta = DRAW;
 
     if (board.hasTerminatorTrait(selectedPiece)) {
         std::array<int, 2> terminatorPlace = board.getTerminatingPlace(selectedPiece);
         bestPlace.first = terminatorPlace[0];
         bestPlace.second = terminatorPlace[1];
-        bestChildMinimax = WIN;
-        goto loopBreak;
+        return WIN;
     }
-    for (int row = 0; row < BOARD_ROWS; row++)
+
+    std::array<int, SQUARE_COUNT> squares;
+    const int squareCount = getPlaceMoves(squares, selectedPiece);
+    orderSquares(squares, squareCount, board.getFilledCount() * 2 + 1, -1, selectedPiece);
+
+    for (int i = 0; i < squareCount; i++)
     {
-        for (int col = 0; col < BOARD_COLS; col++)
+        const int row = squares[i] / BOARD_COLS;
+        const int col = squares[i] % BOARD_COLS;
+        board.set(row, col, selectedPiece);
+        Utility childMinimax = negamaxSelect(alpha, beta);
+        board.set(row, col, -1);
+        if (isStopped())
+            break;
+
+        if (threadIndex == 0 && isVerbose)
+            std::cerr << "row : " << row << ", col : " << col << ", minimax : " << static_cast<int>(childMinimax) << '\n';
+
+        if (childMinimax > bestChildMinimax)
         {
-            if (board.get(row, col) == -1)
-            {
-                board.set(row, col, selectedPiece);
-                Utility childMinimax = negamaxSelect(alpha, beta);
-                board.set(row, col, -1);
-
-                std::cerr << "row : " << row << ", col : " << col << ", minimax : " << static_cast<int>(childMinimax) << '\n';
-
-                if (childMinimax > bestChildMinimax)
-                {
-                    bestChildMinimax = childMinimax;
-                    bestPlace.first = row;
-                    bestPlace.second = col;
-                    if (bestChildMinimax == WIN)
-                        return bestPlace;
-                    alpha = std::max(alpha, bestChildMinimax);
-                }
-            }
+            bestChildMinimax = childMinimax;
+            bestPlace.first = row;
+            bestPlace.second = col;
+            if (bestChildMinimax >= beta)
+                break;
+            alpha = std::max(alpha, bestChildMinimax);
         }
     }
-loopBreak:
+    return bestChildMinimax;
+}
+
+Utility Solver::solveSelect(int& bestPiece)
+{
+    // is it a win?
+    Utility minimax = searchSelect(bestPiece, DRAW, WIN);
+    if (minimax >= WIN || isStopped())
+        return minimax;
+
+    // is it at least a draw? entries of the first probe are reused from the cache
+    minimax = searchSelect(bestPiece, LOSS, DRAW);
+    return minimax >= DRAW ? DRAW : LOSS;
+}
+
+Utility Solver::solvePlace(int selectedPiece, std::pair<int, int>& bestPlace)
+{
+    Utility minimax = searchPlace(selectedPiece, bestPlace, DRAW, WIN);
+    if (minimax >= WIN || isStopped())
+        return minimax;
+
+    minimax = searchPlace(selectedPiece, bestPlace, LOSS, DRAW);
+    return minimax >= DRAW ? DRAW : LOSS;
+}
+
+int Solver::selectPiece()
+{
+    caches->newSearch();
+
+    int bestPiece = -1;
+    solveSelect(bestPiece);
+    if (isStopped())
+        return -1;
+    return bestPiece;
+}
+
+std::pair<int, int> Solver::placePiece(int selectedPiece)
+{
+    caches->newSearch();
+
+    std::pair<int, int> bestPlace = { -1, -1 };
+    solvePlace(selectedPiece, bestPlace);
+    if (isStopped())
+        return { -1, -1 };
+    return bestPlace;
+}
+
+bool Solver::canWinBySelect()
+{
+    caches->newSearch();
+
+    int bestPiece;
+    return searchSelect(bestPiece, DRAW, WIN) >= WIN;
+}
+
+bool Solver::canWinByPlace(int selectedPiece)
+{
+    caches->newSearch();
+
+    std::pair<int, int> bestPlace;
+    return searchPlace(selectedPiece, bestPlace, DRAW, WIN) >= WIN;
+}
+
+template <typename Search>
+void Solver::searchParallel(int threadCount, Search search)
+{
+    std::atomic<bool> stop = false;
+    std::vector<std::unique_ptr<Solver>> helpers;
+    std::vector<std::future<void>> results;
+    helpers.reserve(threadCount);
+    results.reserve(threadCount);
+    for (int i = 1; i < threadCount; i++)
+    {
+        helpers.push_back(std::make_unique<Solver>(board, availablePieces, caches));
+        helpers.back()->threadIndex = i;
+        helpers.back()->parallelStopFlag = &stop;
+        helpers.back()->stopFlag = stopFlag;
+    }
+    parallelStopFlag = &stop;
+
+    // a helper still waiting for a worker when the search ends starts stopped, and returns at once
+    for (auto& helper : helpers)
+    {
+        results.push_back(ThreadPool::getShared().submit([&search, &stop, solver = helper.get()]
+            {
+                search(*solver);
+                stop = true;
+            }));
+    }
+    search(*this);
+    stop = true;
+
+    for (auto& result : results)
+        result.get();
+    parallelStopFlag = nullptr;
+
+    for (const auto& helper : helpers)
+    {
+        cacheProbeCount += helper->cacheProbeCount;
+        cacheHitCount += helper->cacheHitCount;
+        etcCutoffCount += helper->etcCutoffCount;
+        nodeCount += helper->nodeCount;
+    }
+}
+
+int Solver::selectPieceParallel(int threadCount)
+{
+    if (threadCount <= 1)
+        return selectPiece();
+
+    caches->newSearch();
+
+    std::mutex resultMutex;
+    bool isResultFound = false;
+    int bestPiece = -1;
+    searchParallel(threadCount, [&](Solver& solver)
+        {
+            int piece;
+            solver.solveSelect(piece);
+            if (solver.isStopped())
+                return;
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (!isResultFound)
+            {
+                isResultFound = true;
+                bestPiece = piece;
+            }
+        });
+    return bestPiece;
+}
+
+std::pair<int, int> Solver::placePieceParallel(int selectedPiece, int threadCount)
+{
+    if (threadCount <= 1)
+        return placePiece(selectedPiece);
+
+    caches->newSearch();
+
+    std::mutex resultMutex;
+    bool isResultFound = false;
+    std::pair<int, int> bestPlace = { -1, -1 };
+    searchParallel(threadCount, [&](Solver& solver)
+        {
+            std::pair<int, int> place;
+            solver.solvePlace(selectedPiece, place);
+            if (solver.isStopped())
+                return;
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (!isResultFound)
+            {
+                isResultFound = true;
+                bestPlace = place;
+            }
+        });
     return bestPlace;
-}
\ No newline at end of file
+}
@@ -1,43 +1,123 @@
 #pragma once
-#include <set>
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
 #include "Board.h"
+#include "PieceSet.h"
+#include "Tablebase.h"
+#include "TranspositionTable.h"
 
-enum Utility :signed char { UTILITY_MIN = -2, LOSS = -1, DRAW = 0, WIN = 1, UTILITY_MAX = 2 };
-
-struct CacheValue
-{
-    Utility lowerBound;
-    Utility upperBound;
-};
+// plies (filled squares * 2, + 1 to place) from this one are searched by the negamax, the earlier ones by the MCTS
+constexpr int NEGAMAX_START_DEPTH = 7;
 
 class Solver
 {
 private:
     Board board;
-    std::set<int> availablePieces;
-    const size_t CACHE_MEMORY_SIZE = 1024 * 1024 * 1024;
-    static constexpr int unNomarlizedDepth = 0;
-    std::unordered_map<long long, CacheValue> caches;
+    PieceSet availablePieces;
+    static constexpr int unNomarlizedDepth = 24;
+    std::shared_ptr<TranspositionTable> caches;
     inline static const std::string CACHE_FILE_NAME = "cacheFile";
     static constexpr bool SAVE_CACHE_FILE = false;
     static constexpr bool LOAD_CACHE_FILE = false;
+    // exact values of the endgame, probed before the cache
+    const Tablebase* tablebase = &Tablebase::getShared();
+
+    std::size_t cacheProbeCount = 0;
+    std::size_t cacheHitCount = 0;
+    std::size_t etcCutoffCount = 0;
+
+    // parallel search : helper threads visit moves in a different order, and stop when any thread finishes
+    int threadIndex = 0;
+    const std::atomic<bool>* parallelStopFlag = nullptr;
+    // set by the caller, kept through parallel searches
+    const std::atomic<bool>* stopFlag = nullptr;
+    bool isStopped() const;
+
+    std::size_t nodeCount = 0;
+    // prints the value of each root move
+    bool isVerbose = true;
+
+    // move ordering : cached best move and tactical hints, then killer moves, then history
+    static constexpr int PLY_COUNT = PIECE_COUNT * 2 + 1;
+    // tactical hints cost a few dozen operations per move, so they are skipped near the leaves
+    static constexpr int TACTICAL_HINT_FILLED_COUNT = 12;
+    static constexpr int ORDER_TACTICAL_RANGE = 64;
+    static constexpr int ORDER_HISTORY_BITS = 40;
+    bool useMoveOrdering = true;
+    // killerMoves[ply] : last two moves that caused a beta cutoff at the ply
+    std::array<std::array<int, 2>, PLY_COUNT> killerMoves = [] {
+        std::array<std::array<int, 2>, PLY_COUNT> moves{};
+        for (auto& killers : moves)
+            killers = { -1, -1 };
+        return moves;
+    }();
+    std::array<long long, PIECE_COUNT> selectHistory{};
+    std::array<std::array<long long, SQUARE_COUNT>, PIECE_COUNT> placeHistory{};
 
-    bool readCache(int select, long long& normalizedBoard, Utility& alpha, Utility& beta, Utility& bestChildMinimax);
-    void saveCache(long long normalizedBoard, Utility bestChildMinimax, Utility alphaOrig, Utility beta);
+    long long getOrderScore(int ply, int move, int cachedMove, int tacticalScore, long long history) const;
+    static void sortMoves(std::array<int, SQUARE_COUNT>& moves, std::array<long long, SQUARE_COUNT>& scores, int count);
+    void orderPieces(std::array<int, SQUARE_COUNT>& pieces, int count, int ply, int cachedMove) const;
+    void orderSquares(std::array<int, SQUARE_COUNT>& squares, int count, int ply, int cachedMove, int selectedPiece) const;
+    void updateOrderStatistics(int ply, int move, int selectedPiece);
+    // symmetric positions are rare once the board fills, and finding the automorphisms costs a few hundred operations
+    static constexpr int SYMMETRY_PRUNING_FILLED_COUNT = 8;
+    // pieces that do not lose at once, one per orbit of equivalent pieces early in the game
+    int getSelectMoves(std::array<int, SQUARE_COUNT>& pieces, bool& hasTerminatorPiece) const;
+    // empty squares, one per orbit of equivalent squares early in the game
+    int getPlaceMoves(std::array<int, SQUARE_COUNT>& squares, int selectedPiece) const;
+
+    // probing every child costs a key per square, so it is skipped near the leaves
+    static constexpr int ETC_MIN_DRAFT = 12;
+    // a child of the place node whose cached lower bound already reaches beta
+    bool findTranspositionCutoff(int selectedPiece, const std::array<int, SQUARE_COUNT>& squares, int count, Utility beta, Utility& cutoffMinimax, int& cutoffSquare);
+
+    // cachedMove : best move of the cached entry in this position's frame, unchanged if none
+    bool readCache(int select, long long& normalizedBoard, SymmetryTransform& transform, Utility& alpha, Utility& beta, Utility& bestChildMinimax, int& cachedMove);
+    void saveCache(long long normalizedBoard, const SymmetryTransform& transform, int select, int depth, Utility bestChildMinimax, int bestMove, Utility alphaOrig, Utility beta);
 
     Utility negamaxSelect(Utility alpha, Utility beta);
     Utility negamaxPlace(int selectedPiece, Utility alpha, Utility beta);
 
+    // fail-soft root search in the window (alpha, beta)
+    Utility searchSelect(int& bestPiece, Utility alpha, Utility beta);
+    Utility searchPlace(int selectedPiece, std::pair<int, int>& bestPlace, Utility alpha, Utility beta);
+    // runs search(Solver&) on this solver and on threadCount - 1 helpers, tasks of ThreadPool::getShared()
+    template <typename Search>
+    void searchParallel(int threadCount, Search search);
+
 public:
-    Solver(const Board& board, const std::set<int>& availablePieces);
+    static constexpr std::size_t CACHE_MEMORY_SIZE = 1024 * 1024 * 1024;
+
+    Solver(const Board& board, PieceSet availablePieces, std::size_t cacheMemorySize = CACHE_MEMORY_SIZE);
+    Solver(const Board& board, PieceSet availablePieces, std::shared_ptr<TranspositionTable> caches);
     ~Solver();
-    void init(const Board& board, const std::set<int>& availablePieces);
+    void init(const Board& board, PieceSet availablePieces);
 
     void saveCacheFile();
     void loadCacheFile();
+    void printCacheStatistics() const;
+    // for benchmarks
+    void setMoveOrdering(bool useMoveOrdering);
+    std::size_t getNodeCount() const;
+    // off for solvers called many times, like the MCTS leaf evaluation
+    void setVerbose(bool isVerbose);
+    // a search stopped by the flag returns a meaningless value, and selectPiece, placePiece and
+    // their parallel forms return -1 and { -1, -1 }
+    void setStopFlag(const std::atomic<bool>* stopFlag);
+
+    // exact value with at most two null-window probes : "is it a win?", then "is it at least a draw?"
+    Utility solveSelect(int& bestPiece);
+    Utility solvePlace(int selectedPiece, std::pair<int, int>& bestPlace);
 
     int selectPiece();
     std::pair<int, int> placePiece(int selectedPiece);
-};
+    // only whether a forced win exists, a single null-window probe
+    bool canWinBySelect();
+    bool canWinByPlace(int selectedPiece);
 
+    // lazy SMP : threadCount threads search the same position sharing caches, the first result is used
+    int selectPieceParallel(int threadCount);
+    std::pair<int, int> placePieceParallel(int selectedPiece, int threadCount);
+};